@@ -0,0 +1,215 @@
+/*
+ * compose.c - Images composed of several files.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "compose.h"
+#include "elf.h"
+#include "ihex.h"
+#include "srec.h"
+
+// A range of memory written by one of the files
+typedef struct extent_s {
+  size_t start;
+  size_t end;
+  size_t part;
+} extent_t;
+
+typedef struct compose_s {
+  extent_t *extents;
+  size_t count;
+  size_t alloc;
+  size_t part;     // file being added
+  size_t size;     // memory size
+  uint8_t overflow;
+} compose_t;
+
+int is_composed_image(const char *filename) {
+  struct stat st;
+  return (strchr(filename, ',') || strchr(filename, '@')) &&
+         stat(filename, &st);
+}
+
+// Record the memory written by a file. Consecutive hex and S-Record data
+// records make a single extent.
+static void compose_extent(void *ctx, size_t address, size_t len) {
+  compose_t *compose = ctx;
+
+  if (address > compose->size || len > compose->size - address) {
+    compose->overflow = 1;
+    return;
+  }
+  if (compose->count) {
+    extent_t *last = &compose->extents[compose->count - 1];
+    if (last->part == compose->part && last->end == address) {
+      last->end += len;
+      return;
+    }
+  }
+  if (compose->count == compose->alloc) {
+    size_t alloc = compose->alloc ? compose->alloc * 2 : 64;
+    extent_t *extents = realloc(compose->extents, alloc * sizeof(extent_t));
+    if (!extents) {
+      compose->overflow = 2;
+      return;
+    }
+    compose->extents = extents;
+    compose->alloc = alloc;
+  }
+  compose->extents[compose->count].start = address;
+  compose->extents[compose->count].end = address + len;
+  compose->extents[compose->count].part = compose->part;
+  compose->count++;
+}
+
+static int compare_extents(const void *a, const void *b) {
+  const extent_t *x = a, *y = b;
+  return x->start < y->start ? -1 : x->start > y->start;
+}
+
+// Add one file to a composed image
+static int compose_file(image_t *image, compose_t *compose, const char *name,
+                        int64_t offset) {
+  file_data_t file;
+  int ret = EXIT_SUCCESS;
+
+  if (read_input(name, &file)) return EXIT_FAILURE;
+  if (is_elf_data(file.data, file.size)) {
+    fprintf(stderr, "Adding ELF file %s.\n", name);
+    ret = read_elf_file(file.data, file.size, image->buffer, image->size,
+                        offset, compose_extent, compose);
+  } else if (is_text_data(file.data, file.size)) {
+    uint8_t *p;
+    size_t size = image->size;
+    for (p = file.data; *p == '\r' || *p == '\n'; p++)
+      ;
+    if (*p == ':') {
+      fprintf(stderr, "Adding Intel hex file %s.\n", name);
+      ret = read_hex_stream(file.data, image->buffer, &size, offset,
+                            compose_extent, compose);
+      if (ret == NOT_IHEX) fprintf(stderr, "Malformed Intel hex file.\n");
+    } else {
+      fprintf(stderr, "Adding Motorola S-Record file %s.\n", name);
+      ret = read_srec_stream(file.data, image->buffer, &size, offset,
+                             compose_extent, compose);
+      if (ret == NOT_SREC) fprintf(stderr, "Malformed S-Record file.\n");
+    }
+    ret = ret ? EXIT_FAILURE : EXIT_SUCCESS;
+  } else if (offset < 0) {
+    fprintf(stderr, "Negative offset for the binary file %s.\n", name);
+    ret = EXIT_FAILURE;
+  } else {
+    fprintf(stderr, "Adding binary file %s at 0x%llx.\n", name,
+            (unsigned long long)offset);
+    compose_extent(compose, offset, file.size);
+    if (!compose->overflow)
+      memcpy(image->buffer + offset, file.data, file.size);
+  }
+  free_file(&file);
+
+  if (!ret && compose->overflow == 1) {
+    fprintf(stderr, "%s doesn't fit in the memory.\n", name);
+    ret = EXIT_FAILURE;
+  } else if (!ret && compose->overflow) {
+    fprintf(stderr, "Out of memory!\n");
+    ret = EXIT_FAILURE;
+  }
+  return ret;
+}
+
+int compose_image(image_t *image, const char *filename) {
+  compose_t compose;
+  char *p_end;
+  int ret = EXIT_SUCCESS;
+
+  char *list = strdup(filename);
+  char **names = calloc(strlen(filename) + 1, sizeof(char *));
+  image->buffer = malloc(image->size);
+  if (!list || !names || !image->buffer) {
+    fprintf(stderr, "Out of memory!\n");
+    free(list);
+    free(names);
+    free(image->buffer);
+    image->buffer = NULL;
+    return EXIT_FAILURE;
+  }
+  memset(image->buffer, 0xFF, image->size);
+  image->data = image->buffer;
+  memset(&compose, 0, sizeof(compose));
+  compose.size = image->size;
+
+  char *name = list;
+  while (name && !ret) {
+    char *next = strchr(name, ',');
+    if (next) *next++ = 0;
+
+    int64_t offset = 0;
+    char *at = strrchr(name, '@');
+    if (at) {
+      errno = 0;
+      offset = strtoll(at + 1, &p_end, 0);
+      if (p_end != at + 1 && !*p_end && !errno)
+        *at = 0;
+      else
+        offset = 0;
+    }
+    if (!*name) {
+      fprintf(stderr, "Invalid image file list '%s'.\n",
+              filename);
+      ret = EXIT_FAILURE;
+      break;
+    }
+    names[compose.part] = name;
+    ret = compose_file(image, &compose, name, offset);
+    compose.part++;
+    name = next;
+  }
+
+  // Files overlap when an extent starts below the end of another file's
+  // extents seen so far
+  if (!ret && compose.count) {
+    size_t i, end = 0, owner = 0;
+    qsort(compose.extents, compose.count, sizeof(extent_t), compare_extents);
+    for (i = 0; i < compose.count; i++) {
+      extent_t *e = &compose.extents[i];
+      if (e->start < end && e->part != owner) {
+        fprintf(stderr, "%s and %s overlap at 0x%llx.\n", names[owner],
+                names[e->part], (unsigned long long)e->start);
+        ret = EXIT_FAILURE;
+        break;
+      }
+      if (e->end > end) {
+        end = e->end;
+        owner = e->part;
+      }
+    }
+  }
+
+  free(compose.extents);
+  free(names);
+  free(list);
+  if (ret) {
+    free(image->buffer);
+    image->buffer = NULL;
+    image->data = NULL;
+  }
+  return ret;
+}
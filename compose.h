@@ -0,0 +1,33 @@
+/*
+ * compose.h - Declarations for the images composed of several files.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef COMPOSE_H_
+#define COMPOSE_H_
+
+#include "image.h"
+
+// An image is composed of files when the name is a comma separated list of
+// file[@offset] and no file of that name exists
+int is_composed_image(const char *filename);
+
+// Merge the files of a file[@offset],... list into one image of
+// image->size bytes. Hex, S-Record and ELF files are placed by their
+// addresses plus offset, binary files at offset. The gaps are left blank;
+// files writing the same memory are rejected.
+int compose_image(image_t *image, const char *filename);
+
+#endif /* COMPOSE_H_ */
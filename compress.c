@@ -0,0 +1,405 @@
+/*
+ * compress.c - Compressed image support (gzip and zstd).
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#if defined(__GLIBC__) || defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "compress.h"
+
+#define CHUNK_SIZE 65536
+
+struct decompress_s {
+  int method;
+  const uint8_t *data;
+  size_t size;
+  size_t position;  // input handed to the decoder
+  int done;
+#ifdef HAVE_ZLIB
+  z_stream z;
+#endif
+#ifdef HAVE_ZSTD
+  ZSTD_DStream *zstd;
+  ZSTD_inBuffer in;
+#endif
+};
+
+int compress_detect(const uint8_t *data, size_t size) {
+  if (size >= 2 && data[0] == 0x1f && data[1] == 0x8b) return COMPRESS_GZIP;
+  if (size >= 4 && data[0] == 0x28 && data[1] == 0xb5 && data[2] == 0x2f &&
+      data[3] == 0xfd)
+    return COMPRESS_ZSTD;
+  return COMPRESS_NONE;
+}
+
+int compress_method(const char *name) {
+  if (!strcasecmp(name, "gzip") || !strcasecmp(name, "gz"))
+    return COMPRESS_GZIP;
+  if (!strcasecmp(name, "zstd") || !strcasecmp(name, "zst"))
+    return COMPRESS_ZSTD;
+  return -1;
+}
+
+const char *compress_name(int method) {
+  return method == COMPRESS_GZIP ? "gzip" : "zstd";
+}
+
+// Check the method was built in
+static int supported(int method) {
+#ifdef HAVE_ZLIB
+  if (method == COMPRESS_GZIP) return 1;
+#endif
+#ifdef HAVE_ZSTD
+  if (method == COMPRESS_ZSTD) return 1;
+#endif
+  fprintf(stderr, "This minipro was built without %s support.\n",
+          compress_name(method));
+  return 0;
+}
+
+size_t decompress_size(int method, const uint8_t *data, size_t size) {
+  switch (method) {
+    case COMPRESS_GZIP:
+      // The gzip trailer ends with the size modulo 2^32
+      if (size < 18) return 0;
+      data += size - 4;
+      return data[0] | (data[1] << 8) | (data[2] << 16) |
+             ((size_t)data[3] << 24);
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD: {
+      unsigned long long len = ZSTD_getFrameContentSize(data, size);
+      if (len == ZSTD_CONTENTSIZE_UNKNOWN || len == ZSTD_CONTENTSIZE_ERROR)
+        return 0;
+      return len;
+    }
+#endif
+  }
+  return 0;
+}
+
+decompress_t *decompress_open(int method, const uint8_t *data, size_t size) {
+  if (!supported(method)) return NULL;
+  decompress_t *stream = calloc(1, sizeof(decompress_t));
+  if (!stream) {
+    fprintf(stderr, "Out of memory!\n");
+    return NULL;
+  }
+  stream->method = method;
+  stream->data = data;
+  stream->size = size;
+
+#ifdef HAVE_ZLIB
+  // Accept a gzip header only
+  if (method == COMPRESS_GZIP && inflateInit2(&stream->z, 15 + 16) != Z_OK) {
+    fprintf(stderr, "Could not initialize the gzip decoder.\n");
+    free(stream);
+    return NULL;
+  }
+#endif
+#ifdef HAVE_ZSTD
+  if (method == COMPRESS_ZSTD) {
+    stream->zstd = ZSTD_createDStream();
+    if (!stream->zstd || ZSTD_isError(ZSTD_initDStream(stream->zstd))) {
+      fprintf(stderr, "Could not initialize the zstd decoder.\n");
+      ZSTD_freeDStream(stream->zstd);
+      free(stream);
+      return NULL;
+    }
+    stream->in.src = data;
+    stream->in.size = size;
+    stream->in.pos = 0;
+  }
+#endif
+  return stream;
+}
+
+#ifdef HAVE_ZLIB
+static int gzip_read(decompress_t *stream, uint8_t *out, size_t len,
+                     size_t *produced) {
+  z_stream *z = &stream->z;
+
+  z->next_out = out;
+  z->avail_out = len > UINT_MAX ? UINT_MAX : len;
+  len = z->avail_out;
+  while (z->avail_out && !stream->done) {
+    // zlib counts are 32 bit, feed the input in pieces
+    if (!z->avail_in) {
+      size_t left = stream->size - stream->position;
+      if (!left) {
+        fprintf(stderr, "\nTruncated gzip file.\n");
+        return EXIT_FAILURE;
+      }
+      z->next_in = (uint8_t *)stream->data + stream->position;
+      z->avail_in = left > UINT_MAX ? UINT_MAX : left;
+      stream->position += z->avail_in;
+    }
+    int ret = inflate(z, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      // A gzip file can be made of several members
+      if (z->avail_in || stream->position < stream->size)
+        inflateReset(z);
+      else
+        stream->done = 1;
+    } else if (ret != Z_OK) {
+      fprintf(stderr, "\nCorrupt gzip file: %s\n",
+              z->msg ? z->msg : "bad data");
+      return EXIT_FAILURE;
+    }
+  }
+  *produced = len - z->avail_out;
+  return EXIT_SUCCESS;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int zstd_read(decompress_t *stream, uint8_t *out, size_t len,
+                     size_t *produced) {
+  ZSTD_outBuffer output = {out, len, 0};
+
+  while (output.pos < output.size && !stream->done) {
+    size_t ret = ZSTD_decompressStream(stream->zstd, &output, &stream->in);
+    if (ZSTD_isError(ret)) {
+      fprintf(stderr, "\nCorrupt zstd file: %s\n", ZSTD_getErrorName(ret));
+      return EXIT_FAILURE;
+    }
+    if (stream->in.pos == stream->in.size) {
+      // Everything was consumed, the last frame must be complete
+      if (!ret)
+        stream->done = 1;
+      else if (output.pos < output.size) {
+        fprintf(stderr, "\nTruncated zstd file.\n");
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  *produced = output.pos;
+  return EXIT_SUCCESS;
+}
+#endif
+
+int decompress_read(decompress_t *stream, uint8_t *out, size_t len,
+                    size_t *produced) {
+  *produced = 0;
+  if (stream->done) return EXIT_SUCCESS;
+#ifdef HAVE_ZLIB
+  if (stream->method == COMPRESS_GZIP)
+    return gzip_read(stream, out, len, produced);
+#endif
+#ifdef HAVE_ZSTD
+  if (stream->method == COMPRESS_ZSTD)
+    return zstd_read(stream, out, len, produced);
+#endif
+  return EXIT_FAILURE;
+}
+
+void decompress_close(decompress_t *stream) {
+  if (!stream) return;
+#ifdef HAVE_ZLIB
+  if (stream->method == COMPRESS_GZIP) inflateEnd(&stream->z);
+#endif
+#ifdef HAVE_ZSTD
+  if (stream->method == COMPRESS_ZSTD) ZSTD_freeDStream(stream->zstd);
+#endif
+  free(stream);
+}
+
+int decompress_all(int method, const uint8_t *data, size_t size,
+                   uint8_t **out, size_t *out_size) {
+  size_t produced, len = 0;
+  size_t capacity = decompress_size(method, data, size);
+  uint8_t *buffer, *tmp;
+
+  decompress_t *stream = decompress_open(method, data, size);
+  if (!stream) return EXIT_FAILURE;
+  if (!capacity) capacity = size * 4;
+  buffer = malloc(capacity + 1);
+  if (!buffer) {
+    decompress_close(stream);
+    fprintf(stderr, "Out of memory!\n");
+    return EXIT_FAILURE;
+  }
+
+  do {
+    if (len == capacity) {
+      capacity *= 2;
+      tmp = realloc(buffer, capacity + 1);
+      if (!tmp) {
+        free(buffer);
+        decompress_close(stream);
+        fprintf(stderr, "Out of memory!\n");
+        return EXIT_FAILURE;
+      }
+      buffer = tmp;
+    }
+    if (decompress_read(stream, buffer + len, capacity - len, &produced)) {
+      free(buffer);
+      decompress_close(stream);
+      return EXIT_FAILURE;
+    }
+    len += produced;
+  } while (produced);
+  decompress_close(stream);
+
+  buffer[len] = 0;
+  *out = buffer;
+  *out_size = len;
+  return EXIT_SUCCESS;
+}
+
+// Compressing output stream
+typedef struct compress_file_s {
+  FILE *file;
+  int method;
+#ifdef HAVE_ZLIB
+  z_stream z;
+#endif
+#ifdef HAVE_ZSTD
+  ZSTD_CStream *zstd;
+#endif
+  uint8_t out[CHUNK_SIZE];
+} compress_file_t;
+
+// Compress len bytes, finishing the stream if finish is set
+static int compress_chunk(compress_file_t *cf, const uint8_t *data, size_t len,
+                          int finish) {
+#ifdef HAVE_ZLIB
+  if (cf->method == COMPRESS_GZIP) {
+    int ret;
+    cf->z.next_in = (uint8_t *)data;
+    cf->z.avail_in = len;
+    do {
+      cf->z.next_out = cf->out;
+      cf->z.avail_out = sizeof(cf->out);
+      ret = deflate(&cf->z, finish ? Z_FINISH : Z_NO_FLUSH);
+      if (ret == Z_STREAM_ERROR) return EXIT_FAILURE;
+      size_t have = sizeof(cf->out) - cf->z.avail_out;
+      if (fwrite(cf->out, 1, have, cf->file) != have) return EXIT_FAILURE;
+    } while (cf->z.avail_in || (finish && ret != Z_STREAM_END));
+    return EXIT_SUCCESS;
+  }
+#endif
+#ifdef HAVE_ZSTD
+  if (cf->method == COMPRESS_ZSTD) {
+    ZSTD_inBuffer input = {data, len, 0};
+    size_t ret;
+    do {
+      ZSTD_outBuffer output = {cf->out, sizeof(cf->out), 0};
+      ret = ZSTD_compressStream2(cf->zstd, &output, &input,
+                                 finish ? ZSTD_e_end : ZSTD_e_continue);
+      if (ZSTD_isError(ret)) return EXIT_FAILURE;
+      if (fwrite(cf->out, 1, output.pos, cf->file) != output.pos)
+        return EXIT_FAILURE;
+    } while (input.pos < input.size || (finish && ret));
+    return EXIT_SUCCESS;
+  }
+#endif
+  return EXIT_FAILURE;
+}
+
+static ssize_t compress_write(void *cookie, const char *data, size_t len) {
+  size_t done;
+  // zlib counts are 32 bit
+  for (done = 0; done < len; done += CHUNK_SIZE) {
+    size_t chunk = len - done < CHUNK_SIZE ? len - done : CHUNK_SIZE;
+    if (compress_chunk(cookie, (const uint8_t *)data + done, chunk, 0))
+      return -1;
+  }
+  return len;
+}
+
+static int compress_close(void *cookie) {
+  compress_file_t *cf = cookie;
+  int ret = compress_chunk(cf, NULL, 0, 1);
+#ifdef HAVE_ZLIB
+  if (cf->method == COMPRESS_GZIP) deflateEnd(&cf->z);
+#endif
+#ifdef HAVE_ZSTD
+  if (cf->method == COMPRESS_ZSTD) ZSTD_freeCStream(cf->zstd);
+#endif
+  if (fclose(cf->file)) ret = EXIT_FAILURE;
+  free(cf);
+  return ret ? EOF : 0;
+}
+
+#if !defined(__GLIBC__) && !defined(__linux__) && !defined(_WIN32)
+static int compress_write_bsd(void *cookie, const char *data, int len) {
+  return compress_write(cookie, data, len);
+}
+#endif
+
+FILE *compress_fopen(FILE *file, int method) {
+  FILE *stream = NULL;
+
+  if (!supported(method)) return NULL;
+  compress_file_t *cf = calloc(1, sizeof(compress_file_t));
+  if (!cf) {
+    fprintf(stderr, "Out of memory!\n");
+    return NULL;
+  }
+  cf->file = file;
+  cf->method = method;
+#ifdef HAVE_ZLIB
+  // A gzip header, as written by gzip(1)
+  if (method == COMPRESS_GZIP &&
+      deflateInit2(&cf->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    free(cf);
+    fprintf(stderr, "Could not initialize the gzip encoder.\n");
+    return NULL;
+  }
+#endif
+#ifdef HAVE_ZSTD
+  if (method == COMPRESS_ZSTD) {
+    cf->zstd = ZSTD_createCStream();
+    if (!cf->zstd) {
+      free(cf);
+      fprintf(stderr, "Could not initialize the zstd encoder.\n");
+      return NULL;
+    }
+  }
+#endif
+
+#if defined(__GLIBC__) || defined(__linux__)
+  cookie_io_functions_t io = {NULL, compress_write, NULL, compress_close};
+  stream = fopencookie(cf, "w", io);
+#elif !defined(_WIN32)
+  stream = funopen(cf, NULL, compress_write_bsd, NULL, compress_close);
+#endif
+  if (!stream) {
+    fprintf(stderr, "Could not open the compressed output stream.\n");
+#ifdef HAVE_ZLIB
+    if (method == COMPRESS_GZIP) deflateEnd(&cf->z);
+#endif
+#ifdef HAVE_ZSTD
+    if (method == COMPRESS_ZSTD) ZSTD_freeCStream(cf->zstd);
+#endif
+    free(cf);
+  }
+  return stream;
+}
@@ -0,0 +1,57 @@
+/*
+ * compress.h - Declarations for the compressed image support.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Compression methods. gzip needs zlib (HAVE_ZLIB), zstd needs libzstd
+// (HAVE_ZSTD); a method missing from the build is still detected, so the
+// file is reported instead of being taken for a binary image.
+enum { COMPRESS_NONE = 0, COMPRESS_GZIP, COMPRESS_ZSTD };
+
+// Detect a compressed stream by its magic bytes
+int compress_detect(const uint8_t *data, size_t size);
+// Method by name (gzip, gz, zstd, zst), -1 if unknown
+int compress_method(const char *name);
+const char *compress_name(int method);
+
+// Decompressed size recorded in the stream, 0 if unknown
+size_t decompress_size(int method, const uint8_t *data, size_t size);
+
+typedef struct decompress_s decompress_t;
+
+// Streaming decompression of a whole compressed buffer
+decompress_t *decompress_open(int method, const uint8_t *data, size_t size);
+// Decompress up to len bytes into out. *produced is 0 at the end of the
+// stream.
+int decompress_read(decompress_t *stream, uint8_t *out, size_t len,
+                    size_t *produced);
+void decompress_close(decompress_t *stream);
+
+// Decompress a whole buffer into a new zero terminated one
+int decompress_all(int method, const uint8_t *data, size_t size,
+                   uint8_t **out, size_t *out_size);
+
+// A stream compressing everything written into file. Closing it
+// finishes the compressed stream and closes file.
+FILE *compress_fopen(FILE *file, int method);
+
+#endif /* COMPRESS_H_ */
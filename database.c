@@ -15,6 +15,8 @@
  *
  */
 #define _GNU_SOURCE
+#include <ctype.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,6 +30,11 @@
 	#include <shlwapi.h>
 	#define STRCASESTR StrStrIA
 #else
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <pthread.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
 	#define STRCASESTR strcasestr
 #endif
 
@@ -38,6 +45,7 @@ pin_map_t pin_map_table[] = {
 
 // infoic.xml name and tag names
 #define DATABASE_NAME "infoic.xml"
+#define DATABASE_PATH_MAX 4096
 #define DEVICE_TAG "device"
 #define MANUF_TAG "manufacturer"
 #define CUSTOM_TAG "custom"
@@ -63,6 +71,7 @@ typedef struct state_machine {
   uint32_t tl866a_custom_count;
   uint32_t tl866ii_count;
   uint32_t tl866ii_custom_count;
+  struct db_builder_s *builder;  // compiling the binary cache
 } state_machine_t;
 
 
@@ -343,6 +352,23 @@ gal_config_t gal6b_acw[] = { // e.g. for ATF750C
      .acw_size = 3*10 + 4*10}};
 */
 
+// Configuration tables by their name in the fuses attribute, in the order
+// they are matched
+static const struct {
+  const char *name;
+  void *config;
+} config_table[] = {
+    {"atmel_lock", atmel_lock},     {"avr_fuses", avr_fuses},
+    {"avr2_fuses", avr2_fuses},     {"avr3_fuses", avr3_fuses},
+    {"pic_fuses", pic_fuses},       {"pic2_fuses", pic2_fuses},
+    {"pic3_fuses", pic3_fuses},     {"pic4_fuses", pic4_fuses},
+    {"gal1_acw", gal1_acw},         {"gal2_acw", gal2_acw},
+    {"gal3_acw", gal3_acw},         {"gal4_acw", gal4_acw},
+    {"gal5_acw", gal5_acw},         {"atf16V8c_acw", atf16V8c_acw},
+    {"atf22v10c_acw", atf22v10c_acw}, {"atf750c_acw", atf750c_acw},
+    {"NULL", NULL}};
+#define CONFIG_COUNT (sizeof(config_table) / sizeof(config_table[0]))
+
 // Parse a numeric value from an attribute tag
 static uint32_t get_value(const uint8_t *xml_device, size_t size,
                           char *attr_name, int *err) {
@@ -403,43 +429,14 @@ static int load_device(const uint8_t *xml_device, size_t size, device_t *device,
       (Memblock){strlen(FUSE_ATTRIBUTE), (uint8_t *)FUSE_ATTRIBUTE});
   if (!fuses.b) return EXIT_FAILURE;
 
-  if (!strncasecmp((char *)fuses.b, "atmel_lock", fuses.z))
-    device->config = atmel_lock;
-  else if (!strncasecmp((char *)fuses.b, "avr_fuses", fuses.z))
-    device->config = avr_fuses;
-  else if (!strncasecmp((char *)fuses.b, "avr2_fuses", fuses.z))
-    device->config = avr2_fuses;
-  else if (!strncasecmp((char *)fuses.b, "avr3_fuses", fuses.z))
-    device->config = avr3_fuses;
-  else if (!strncasecmp((char *)fuses.b, "pic_fuses", fuses.z))
-    device->config = pic_fuses;
-  else if (!strncasecmp((char *)fuses.b, "pic2_fuses", fuses.z))
-    device->config = pic2_fuses;
-  else if (!strncasecmp((char *)fuses.b, "pic3_fuses", fuses.z))
-    device->config = pic3_fuses;
-  else if (!strncasecmp((char *)fuses.b, "pic4_fuses", fuses.z))
-    device->config = pic4_fuses;
-  else if (!strncasecmp((char *)fuses.b, "gal1_acw", fuses.z))
-    device->config = gal1_acw;
-  else if (!strncasecmp((char *)fuses.b, "gal2_acw", fuses.z))
-    device->config = gal2_acw;
-  else if (!strncasecmp((char *)fuses.b, "gal3_acw", fuses.z))
-    device->config = gal3_acw;
-  else if (!strncasecmp((char *)fuses.b, "gal4_acw", fuses.z))
-    device->config = gal4_acw;
-  else if (!strncasecmp((char *)fuses.b, "gal5_acw", fuses.z))
-    device->config = gal5_acw;
-  else if (!strncasecmp((char *)fuses.b, "atf16V8c_acw", fuses.z))
-    device->config = atf16V8c_acw;
-  else if (!strncasecmp((char *)fuses.b, "atf22v10c_acw", fuses.z))
-    device->config = atf22v10c_acw;
-  else if (!strncasecmp((char *)fuses.b, "atf750c_acw", fuses.z))
-    device->config = atf750c_acw;
-  else if (!strncasecmp((char *)fuses.b, "NULL", fuses.z))
-    device->config = NULL;
-  else
-    return EXIT_FAILURE;
-  return EXIT_SUCCESS;
+  size_t i;
+  for (i = 0; i < CONFIG_COUNT; i++) {
+    if (!strncasecmp((char *)fuses.b, config_table[i].name, fuses.z)) {
+      device->config = config_table[i].config;
+      return EXIT_SUCCESS;
+    }
+  }
+  return EXIT_FAILURE;
 }
 
 // Compare a device by protocol ID/device ID or protocol ID/package
@@ -473,6 +470,170 @@ static int compare_device(const uint8_t *xml_device, size_t size,
   return EXIT_SUCCESS;
 }
 
+/* Binary cache of the database */
+
+// infoic.xml compiled into fixed size device records and a string table
+// of their names. The records of each database are kept together, in the
+// order of the xml, so a listing scans the mapped records of one database
+// with the same first match/custom override rules as the xml parser.
+// A name lookup goes through a case insensitive hash index of each
+// database instead, which holds the record these rules would pick.
+#define DB_CACHE_MAGIC "MPDB0002"
+
+enum { DB_TL866A = 0, DB_TL866II, DB_COUNT };
+
+typedef struct db_record_s {
+  uint32_t name;  // offset in the string table
+  uint32_t code_memory_size;
+  uint32_t data_memory_size;
+  uint32_t data_memory2_size;
+  uint32_t chip_id;
+  uint32_t opts1;
+  uint32_t opts3;
+  uint32_t opts4;
+  uint32_t opts5;
+  uint32_t opts6;
+  uint32_t opts8;
+  uint32_t package_details;
+  uint16_t read_buffer_size;
+  uint16_t write_buffer_size;
+  uint16_t opts2;
+  uint16_t opts7;
+  uint8_t protocol_id;
+  uint8_t variant;
+  uint8_t chip_id_bytes_count;
+  uint8_t config;  // index in config_table
+  uint8_t custom;
+  uint8_t unused[3];
+} db_record_t;
+
+// The cache file: this header, the records of each database, the hash
+// index of each database and the string table. The xml time and size tell
+// a changed xml at once; when they differ the CRC32 of the xml decides, so
+// an identical reinstalled xml keeps its cache.
+typedef struct db_header_s {
+  char magic[8];
+  uint32_t record_size;       // sizeof(db_record_t)
+  uint32_t first[DB_COUNT];   // index of the first record of a database
+  uint32_t count[DB_COUNT];   // records of a database
+  uint32_t devices[DB_COUNT]; // device and custom device counts of the xml
+  uint32_t custom[DB_COUNT];
+  uint32_t strings_size;
+  uint32_t index_size[DB_COUNT]; // hash index slots, a power of two
+  int64_t xml_mtime;         // in nanoseconds
+  uint64_t xml_size;
+  uint32_t xml_crc;
+} db_header_t;
+
+typedef struct db_builder_s {
+  db_record_t *records[DB_COUNT];
+  size_t count[DB_COUNT];
+  size_t alloc[DB_COUNT];
+  uint32_t *index[DB_COUNT];
+  size_t index_size[DB_COUNT];
+  char *strings;
+  size_t strings_size;
+  size_t strings_alloc;
+} db_builder_t;
+
+// FNV-1a hash of a device name, case insensitive like strcasecmp
+static uint32_t db_hash(const char *name) {
+  uint32_t hash = 2166136261u;
+  while (*name) {
+    hash ^= (uint8_t)tolower((uint8_t)*name++);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Build the name index of a database. Slots hold a record number plus one,
+// zero is empty, and are probed linearly. A name used several times keeps
+// its first record unless a later one is custom, as in the xml search.
+static int build_db_index(db_builder_t *builder, int db) {
+  size_t size = 16, i;
+
+  while (size < builder->count[db] * 2) size *= 2;
+  uint32_t *index = calloc(size, sizeof(uint32_t));
+  if (!index) return EXIT_FAILURE;
+  builder->index[db] = index;
+  builder->index_size[db] = size;
+
+  for (i = 0; i < builder->count[db]; i++) {
+    db_record_t *record = &builder->records[db][i];
+    const char *name = builder->strings + record->name;
+    size_t slot = db_hash(name) & (size - 1);
+    while (index[slot] &&
+           strcasecmp(builder->strings +
+                          builder->records[db][index[slot] - 1].name,
+                      name))
+      slot = (slot + 1) & (size - 1);
+    if (!index[slot] || record->custom) index[slot] = i + 1;
+  }
+  return EXIT_SUCCESS;
+}
+
+// Compile an 'ic' tag into a record of the cache. Devices that can't be
+// loaded fail the whole cache, the xml parser then reports them as before.
+static int add_record(state_machine_t *sm, const uint8_t *tag, size_t taglen) {
+  db_builder_t *builder = sm->builder;
+  device_t device;
+  size_t i;
+
+  if (sm->sm_version != MP_TL866A && sm->sm_version != MP_TL866IIPLUS)
+    return XML_OK;
+  int db = sm->sm_version == MP_TL866IIPLUS ? DB_TL866II : DB_TL866A;
+  memset(&device, 0, sizeof(device));
+  if (load_device(tag, taglen, &device, sm->sm_version)) return EXIT_FAILURE;
+
+  size_t len = strnlen(device.name, sizeof(device.name));
+  if (builder->strings_size + len + 1 > builder->strings_alloc) {
+    size_t alloc = builder->strings_alloc * 2 + len + 1 + 65536;
+    char *strings = realloc(builder->strings, alloc);
+    if (!strings) return EXIT_FAILURE;
+    builder->strings = strings;
+    builder->strings_alloc = alloc;
+  }
+  if (builder->count[db] == builder->alloc[db]) {
+    size_t alloc = builder->alloc[db] ? builder->alloc[db] * 2 : 1024;
+    db_record_t *records =
+        realloc(builder->records[db], alloc * sizeof(db_record_t));
+    if (!records) return EXIT_FAILURE;
+    builder->records[db] = records;
+    builder->alloc[db] = alloc;
+  }
+
+  db_record_t *record = &builder->records[db][builder->count[db]++];
+  memset(record, 0, sizeof(db_record_t));
+  record->name = builder->strings_size;
+  memcpy(builder->strings + builder->strings_size, device.name, len);
+  builder->strings[builder->strings_size + len] = 0;
+  builder->strings_size += len + 1;
+
+  record->code_memory_size = device.code_memory_size;
+  record->data_memory_size = device.data_memory_size;
+  record->data_memory2_size = device.data_memory2_size;
+  record->chip_id = device.chip_id;
+  record->opts1 = device.opts1;
+  record->opts3 = device.opts3;
+  record->opts4 = device.opts4;
+  record->opts5 = device.opts5;
+  record->opts6 = device.opts6;
+  record->opts8 = device.opts8;
+  record->package_details = device.package_details;
+  record->read_buffer_size = device.read_buffer_size;
+  record->write_buffer_size = device.write_buffer_size;
+  record->opts2 = device.opts2;
+  record->opts7 = device.opts7;
+  record->protocol_id = device.protocol_id;
+  record->variant = device.variant;
+  record->chip_id_bytes_count = device.chip_id_bytes_count;
+  record->custom = sm->custom == 1;
+  for (i = 0; i < CONFIG_COUNT; i++)
+    if (config_table[i].config == device.config) break;
+  record->config = i;
+  return XML_OK;
+}
+
 // XML SAX parser handler. Each xml tag pair is dispatched here.
 // The persistent state machine data is kept in parser->userdata structure
 static int sax_callback(int type, const uint8_t *tag, size_t taglen,
@@ -507,6 +668,7 @@ static int sax_callback(int type, const uint8_t *tag, size_t taglen,
       } else if (sm->sm_version == MP_TL866A) {
         sm->custom ? sm->tl866a_custom_count++ : sm->tl866a_count++;
       }
+      if (sm->builder) return add_record(sm, tag, taglen);
       /*
        * Filter only devices from the desired database.
        * We pass 0 to sm->version to just traverse the entire xml
@@ -567,36 +729,34 @@ static int sax_callback(int type, const uint8_t *tag, size_t taglen,
   return XML_OK;
 }
 
-// Search and return database xml file
-static FILE* get_database_file(){
-#ifdef _WIN32
-  char appdata[MAX_PATH];
-  SHGetSpecialFolderPathA(NULL, appdata, CSIDL_COMMON_APPDATA, 0);
-  strcat(appdata, "\\minipro\\" DATABASE_NAME);
-#endif
-
-  struct stat st;
-  int ret1 = stat(
+// Search the database xml file and copy its path into path
+static int get_database_path(char *path, size_t size, int verbose) {
 #ifdef _WIN32
-      appdata, &st);
+  char share[MAX_PATH];
+  SHGetSpecialFolderPathA(NULL, share, CSIDL_COMMON_APPDATA, 0);
+  strcat(share, "\\minipro\\" DATABASE_NAME);
 #else
-      SHARE_INSTDIR "/" DATABASE_NAME, &st);
+  const char *share = SHARE_INSTDIR "/" DATABASE_NAME;
 #endif
 
+  struct stat st;
+  int ret1 = stat(share, &st);
   int ret2 = stat(DATABASE_NAME, &st);
   if (ret1 && ret2) {
-    fprintf(stderr, "Could not load %s database file.\n", DATABASE_NAME);
-    perror("");
-    return NULL;
+    if (verbose) {
+      fprintf(stderr, "Could not load %s database file.\n", DATABASE_NAME);
+      perror("");
+    }
+    return EXIT_FAILURE;
   }
+  snprintf(path, size, "%s", ret2 ? share : DATABASE_NAME);
+  return EXIT_SUCCESS;
+}
 
-  char *path =
-#ifdef _WIN32
-      appdata;
-#else
-      SHARE_INSTDIR "/" DATABASE_NAME;
-#endif
-  if (!ret2) path = DATABASE_NAME;
+// Search and return database xml file
+static FILE* get_database_file(){
+  char path[DATABASE_PATH_MAX];
+  if (get_database_path(path, sizeof(path), 1)) return NULL;
   // Open datbase xml file
   FILE *file = fopen(path, "rb");
   if (!file) return perror(path), NULL;
@@ -622,6 +782,365 @@ static int parse_xml(state_machine_t *sm) {
   return EXIT_SUCCESS;
 }
 
+#ifndef _WIN32
+// The mapped cache is shared by all handles. db_cache_lock is held while
+// it is checked against the xml, rebuilt or searched.
+static pthread_mutex_t db_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static db_header_t *db_cache;
+static size_t db_cache_size;
+static struct stat db_cache_xml;  // the xml the cache was checked against
+static int db_cache_checked;
+
+// File time in nanoseconds, a change within the same second is seen too
+static int64_t file_time(struct stat *st) {
+#ifdef __APPLE__
+  return st->st_mtimespec.tv_sec * 1000000000LL + st->st_mtimespec.tv_nsec;
+#else
+  return st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+#endif
+}
+
+// CRC32 of the xml file
+static int crc_file(const char *path, uint32_t *crc) {
+  uint8_t buffer[65536];
+  size_t len;
+
+  FILE *file = fopen(path, "rb");
+  if (!file) return EXIT_FAILURE;
+  *crc = 0xFFFFFFFF;
+  while ((len = fread(buffer, 1, sizeof(buffer), file)))
+    *crc = minipro_crc32(buffer, len, *crc);
+  *crc = ~*crc;
+  int ret = ferror(file) ? EXIT_FAILURE : EXIT_SUCCESS;
+  fclose(file);
+  return ret;
+}
+
+// The cache file of an xml file, named after its full path
+static char *db_cache_name(const char *xml_path) {
+  char *dir = minipro_cache_dir();
+  if (!dir) return NULL;
+  char *real = realpath(xml_path, NULL);
+  char *path = real ? real : (char *)xml_path;
+  uint32_t hash = ~minipro_crc32((uint8_t *)path, strlen(path), 0xFFFFFFFF);
+  char *name = malloc(strlen(dir) + sizeof("/infoic-00000000.db"));
+  if (name) sprintf(name, "%s/infoic-%08x.db", dir, hash);
+  free(real);
+  free(dir);
+  return name;
+}
+
+// Compile the xml into a new cache file, replaced atomically
+static int build_db_cache(const char *xml_path, struct stat *xml_st,
+                          const char *name) {
+  db_builder_t builder;
+  db_header_t header;
+  int ret = EXIT_FAILURE;
+
+  memset(&builder, 0, sizeof(builder));
+  memset(&header, 0, sizeof(header));
+  state_machine_t sm = {NULL, 0, -1, -1, 0, 0, 0, NULL, 0, 0, 0, 0, &builder};
+  FILE *file = fopen(xml_path, "rb");
+  if (!file) return EXIT_FAILURE;
+  Parser parser = {file, sax_callback, &sm};
+  int parsed = parse(&parser);
+  done(&parser);
+  fclose(file);
+
+  char *temp = malloc(strlen(name) + sizeof(".XXXXXX"));
+  if (!parsed && temp && !build_db_index(&builder, DB_TL866A) &&
+      !build_db_index(&builder, DB_TL866II) &&
+      !crc_file(xml_path, &header.xml_crc)) {
+    memcpy(header.magic, DB_CACHE_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(db_record_t);
+    header.count[DB_TL866A] = builder.count[DB_TL866A];
+    header.count[DB_TL866II] = builder.count[DB_TL866II];
+    header.first[DB_TL866II] = builder.count[DB_TL866A];
+    header.devices[DB_TL866A] = sm.tl866a_count;
+    header.custom[DB_TL866A] = sm.tl866a_custom_count;
+    header.devices[DB_TL866II] = sm.tl866ii_count;
+    header.custom[DB_TL866II] = sm.tl866ii_custom_count;
+    header.strings_size = builder.strings_size;
+    header.index_size[DB_TL866A] = builder.index_size[DB_TL866A];
+    header.index_size[DB_TL866II] = builder.index_size[DB_TL866II];
+    header.xml_mtime = file_time(xml_st);
+    header.xml_size = xml_st->st_size;
+
+    sprintf(temp, "%s.XXXXXX", name);
+    int fd = mkstemp(temp);
+    FILE *out = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (!out && fd >= 0) {
+      close(fd);
+      unlink(temp);
+    }
+    if (out) {
+      int error =
+          fwrite(&header, sizeof(header), 1, out) != 1 ||
+          fwrite(builder.records[DB_TL866A], sizeof(db_record_t),
+                 builder.count[DB_TL866A], out) != builder.count[DB_TL866A] ||
+          fwrite(builder.records[DB_TL866II], sizeof(db_record_t),
+                 builder.count[DB_TL866II],
+                 out) != builder.count[DB_TL866II] ||
+          fwrite(builder.index[DB_TL866A], sizeof(uint32_t),
+                 builder.index_size[DB_TL866A],
+                 out) != builder.index_size[DB_TL866A] ||
+          fwrite(builder.index[DB_TL866II], sizeof(uint32_t),
+                 builder.index_size[DB_TL866II],
+                 out) != builder.index_size[DB_TL866II] ||
+          fwrite(builder.strings, 1, builder.strings_size, out) !=
+              builder.strings_size;
+      if (fclose(out) || error || rename(temp, name))
+        unlink(temp);
+      else
+        ret = EXIT_SUCCESS;
+    }
+  }
+  free(temp);
+  free(builder.records[DB_TL866A]);
+  free(builder.records[DB_TL866II]);
+  free(builder.index[DB_TL866A]);
+  free(builder.index[DB_TL866II]);
+  free(builder.strings);
+  return ret;
+}
+
+// Map a cache file if it is valid and up to date with the xml
+static db_header_t *map_db_cache(const char *name, const char *xml_path,
+                                 struct stat *xml_st, size_t *size) {
+  struct stat st;
+  int fd = open(name, O_RDWR);
+  if (fd < 0) fd = open(name, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) || (size_t)st.st_size < sizeof(db_header_t)) {
+    close(fd);
+    return NULL;
+  }
+  db_header_t *db = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (db == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+
+  uint64_t records = (uint64_t)db->count[DB_TL866A] + db->count[DB_TL866II];
+  uint64_t slots =
+      (uint64_t)db->index_size[DB_TL866A] + db->index_size[DB_TL866II];
+  int valid = !memcmp(db->magic, DB_CACHE_MAGIC, sizeof(db->magic)) &&
+              db->record_size == sizeof(db_record_t) &&
+              db->first[DB_TL866A] == 0 &&
+              db->first[DB_TL866II] == db->count[DB_TL866A] &&
+              db->strings_size &&
+              db->index_size[DB_TL866A] > db->count[DB_TL866A] &&
+              db->index_size[DB_TL866II] > db->count[DB_TL866II] &&
+              !(db->index_size[DB_TL866A] &
+                (db->index_size[DB_TL866A] - 1)) &&
+              !(db->index_size[DB_TL866II] &
+                (db->index_size[DB_TL866II] - 1)) &&
+              (uint64_t)st.st_size == sizeof(db_header_t) +
+                                          records * sizeof(db_record_t) +
+                                          slots * sizeof(uint32_t) +
+                                          db->strings_size &&
+              !((char *)db)[st.st_size - 1];
+  int fresh = db->xml_mtime == file_time(xml_st) &&
+              db->xml_size == (uint64_t)xml_st->st_size;
+  if (valid && !fresh && db->xml_size == (uint64_t)xml_st->st_size) {
+    // Same contents with a new time: keep the cache, with the new time
+    uint32_t crc;
+    if (!crc_file(xml_path, &crc) && crc == db->xml_crc) {
+      // Best effort, a read-only cache still matches the xml
+      int64_t mtime = file_time(xml_st);
+      ssize_t written = pwrite(fd, &mtime, sizeof(mtime),
+                               offsetof(db_header_t, xml_mtime));
+      (void)written;
+      fresh = 1;
+    }
+  }
+  close(fd);
+  if (!valid || !fresh) {
+    munmap(db, st.st_size);
+    return NULL;
+  }
+  *size = st.st_size;
+  return db;
+}
+
+// Whether the xml is still the file the cache was checked against
+static int same_xml(struct stat *st) {
+  return db_cache_checked && st->st_dev == db_cache_xml.st_dev &&
+         st->st_ino == db_cache_xml.st_ino &&
+         st->st_size == db_cache_xml.st_size &&
+         file_time(st) == file_time(&db_cache_xml);
+}
+
+// The cache of the database, compiled on first use and mapped again when
+// the xml changes, so a long running process sees an updated database.
+// NULL if there is no cache directory or the xml can't be compiled, the
+// xml parser is used then. Called with db_cache_lock held.
+static db_header_t *get_db_cache() {
+  char xml_path[DATABASE_PATH_MAX];
+  struct stat st;
+
+  if (get_database_path(xml_path, sizeof(xml_path), 0) || stat(xml_path, &st))
+    return NULL;
+  if (same_xml(&st)) return db_cache;
+
+  if (db_cache) munmap(db_cache, db_cache_size);
+  db_cache = NULL;
+  db_cache_xml = st;
+  db_cache_checked = 1;
+  char *name = db_cache_name(xml_path);
+  if (!name) return NULL;
+  db_cache = map_db_cache(name, xml_path, &st, &db_cache_size);
+  if (!db_cache && !build_db_cache(xml_path, &st, name))
+    db_cache = map_db_cache(name, xml_path, &st, &db_cache_size);
+  free(name);
+  return db_cache;
+}
+
+static int db_index(uint8_t version) {
+  if (version == MP_TL866A) return DB_TL866A;
+  if (version == MP_TL866IIPLUS) return DB_TL866II;
+  return -1;
+}
+
+static const db_record_t *db_records(db_header_t *db, int index) {
+  return (const db_record_t *)(db + 1) + db->first[index];
+}
+
+static const uint32_t *db_index_table(db_header_t *db, int index) {
+  const uint32_t *table =
+      (const uint32_t *)((const db_record_t *)(db + 1) +
+                         db->count[DB_TL866A] + db->count[DB_TL866II]);
+  return index == DB_TL866II ? table + db->index_size[DB_TL866A] : table;
+}
+
+static const char *db_name(db_header_t *db, const db_record_t *record) {
+  const char *strings = (const char *)(db_index_table(db, DB_TL866II) +
+                                       db->index_size[DB_TL866II]);
+  return record->name < db->strings_size ? strings + record->name : "";
+}
+
+// The record of a device name in the hash index, NULL if there is none
+static const db_record_t *db_lookup(db_header_t *db, int index,
+                                    const char *name) {
+  const uint32_t *table = db_index_table(db, index);
+  uint32_t mask = db->index_size[index] - 1;
+  uint32_t slot = db_hash(name) & mask;
+
+  for (; table[slot]; slot = (slot + 1) & mask) {
+    if (table[slot] > db->count[index]) return NULL;
+    const db_record_t *record = db_records(db, index) + table[slot] - 1;
+    if (!strcasecmp(db_name(db, record), name)) return record;
+  }
+  return NULL;
+}
+
+// Same as load_device
+static void db_load(db_header_t *db, const db_record_t *record,
+                    device_t *device) {
+  strncpy(device->name, db_name(db, record), sizeof(device->name));
+  device->protocol_id = record->protocol_id;
+  device->variant = record->variant;
+  device->read_buffer_size = record->read_buffer_size;
+  device->write_buffer_size = record->write_buffer_size;
+  device->code_memory_size = record->code_memory_size;
+  device->data_memory_size = record->data_memory_size;
+  device->data_memory2_size = record->data_memory2_size;
+  device->chip_id = record->chip_id;
+  device->chip_id_bytes_count = record->chip_id_bytes_count;
+  device->opts1 = record->opts1;
+  device->opts2 = record->opts2;
+  device->opts3 = record->opts3;
+  device->opts4 = record->opts4;
+  device->opts5 = record->opts5;
+  device->opts6 = record->opts6;
+  device->opts7 = record->opts7;
+  device->opts8 = record->opts8;
+  device->package_details = record->package_details;
+  device->config = record->config < CONFIG_COUNT
+                       ? config_table[record->config].config
+                       : NULL;
+}
+
+// Same as compare_device
+static void db_compare(db_header_t *db, const db_record_t *record,
+                       device_t *device) {
+  uint32_t pin_count = get_pin_count(record->package_details);
+  uint8_t match_package =
+      device->package_details ? (device->package_details == pin_count) : 1;
+
+  if (record->chip_id && record->chip_id_bytes_count && match_package &&
+      device->chip_id && device->chip_id == record->chip_id &&
+      (match_package || device->protocol_id == record->protocol_id))
+    strncpy(device->name, db_name(db, record), sizeof(device->name));
+}
+
+// The device lookups of the sax callback on the cache
+static int db_find(db_header_t *db, state_machine_t *sm) {
+  int index = db_index(sm->version);
+  if (index < 0) return EXIT_SUCCESS;
+  const db_record_t *record;
+  uint32_t i;
+
+  // Search and load device (-p and -d)
+  if (!sm->print_name && sm->device_name) {
+    record = db_lookup(db, index, sm->device_name);
+    if (record) {
+      db_load(db, record, sm->device);
+      sm->found = 1;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  record = db_records(db, index);
+  for (i = 0; i < db->count[index]; i++, record++) {
+    const char *name = db_name(db, record);
+
+    // Only print device name
+    if (sm->print_name) {
+      if (sm->match_id) {
+        db_compare(db, record, sm->device);
+        if (strlen(sm->device->name)) {
+          fprintf(stdout, "%s%s\n", sm->device->name,
+                  record->custom ? "(custom)" : "");
+          fflush(stdout);
+          sm->found++;
+          memset(sm->device->name, 0, sizeof(sm->device->name));
+        }
+      } else if (!sm->device_name || STRCASESTR(name, sm->device_name)) {
+        fprintf(stdout, "%s%s\n", name, record->custom ? "(custom)" : "");
+        fflush(stdout);
+      }
+      continue;
+    }
+
+    if (sm->found && !record->custom) continue;
+    // Search by chip ID (get_device_from_id)
+    db_compare(db, record, sm->device);
+    if (strlen(sm->device->name)) sm->found = 1;
+  }
+  return EXIT_SUCCESS;
+}
+#endif
+
+// Look up the database: in the binary cache, or by parsing the xml
+static int search_database(state_machine_t *sm) {
+#ifndef _WIN32
+  pthread_mutex_lock(&db_cache_lock);
+  db_header_t *db = get_db_cache();
+  if (db) {
+    sm->tl866a_count = db->devices[DB_TL866A];
+    sm->tl866a_custom_count = db->custom[DB_TL866A];
+    sm->tl866ii_count = db->devices[DB_TL866II];
+    sm->tl866ii_custom_count = db->custom[DB_TL866II];
+    int ret = db_find(db, sm);
+    pthread_mutex_unlock(&db_cache_lock);
+    return ret;
+  }
+  pthread_mutex_unlock(&db_cache_lock);
+#endif
+  return parse_xml(sm);
+}
+
 // XML based device search
 device_t *get_device_by_name(uint8_t version, const char *name) {
   if (!name) return NULL;
@@ -636,7 +1155,7 @@ device_t *get_device_by_name(uint8_t version, const char *name) {
 
   if (version == MP_TL866CS) version = MP_TL866A;
   state_machine_t sm = {device, version, -1, -1, 0, 0, 0, name, 0, 0, 0, 0};
-  int ret = parse_xml(&sm);
+  int ret = search_database(&sm);
 
   if (ret || !sm.found) {
     free(device);
@@ -656,7 +1175,7 @@ const char *get_device_from_id(uint8_t version, uint32_t chip_id, uint8_t protoc
   if (version == MP_TL866CS) version = MP_TL866A;
   state_machine_t sm = {&device, version, -1, -1, 0, 0, 1, NULL, 0, 0, 0, 0};
 
-  if(parse_xml(&sm)) return NULL;
+  if(search_database(&sm)) return NULL;
   return sm.found ? strdup(device.name) : NULL;
 }
 
@@ -674,7 +1193,7 @@ int list_devices(uint8_t version, const char *name, uint32_t chip_id,
   int flag = (chip_id || package_details) ? 1 : 0;
   state_machine_t sm = {&device, version, -1, -1, 1, 0, flag, name, 0, 0, 0, 0};
 
-  if (parse_xml(&sm)) return EXIT_FAILURE;
+  if (search_database(&sm)) return EXIT_FAILURE;
   if (count) *count = sm.found;
   return EXIT_SUCCESS;
 }
@@ -684,7 +1203,7 @@ int print_chip_count() {
   // Initialize state machine structure
   state_machine_t sm = {NULL, 0, -1, -1, 0, 0, 0, NULL, 0, 0, 0, 0};
 
-  if (parse_xml(&sm)) return EXIT_FAILURE;
+  if (search_database(&sm)) return EXIT_FAILURE;
 
   fprintf(stderr,
           "TL866A/CS:\t%u devices, %u custom\nTL866II+:\t%u devices, %u custom\n",
@@ -0,0 +1,124 @@
+/*
+ * elf.c - Functions for loading the segments of ELF files.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "elf.h"
+
+#define ELFCLASS32 1
+#define ELFCLASS64 2
+#define ELFDATA2LSB 1
+#define ELFDATA2MSB 2
+#define PT_LOAD 1
+
+typedef struct {
+  const uint8_t *buffer;
+  uint8_t is64;
+  uint8_t msb;
+} elf_t;
+
+// Read an unsigned field of len bytes in the byte order of the file
+static uint64_t field(elf_t *elf, size_t offset, size_t len) {
+  uint64_t value = 0;
+  size_t i;
+  for (i = 0; i < len; i++)
+    value |= (uint64_t)elf->buffer[offset + (elf->msb ? len - 1 - i : i)]
+             << (8 * i);
+  return value;
+}
+
+// Probe for the ELF magic
+int is_elf_data(const uint8_t *buffer, size_t size) {
+  return size >= 4 && !memcmp(buffer, "\177ELF", 4);
+}
+
+// Copy the file contents of the loadable segments of an ELF file into
+// data, at their physical address plus offset. The memory sizes past the
+// file contents (.bss) are not part of the image. The optional progress
+// callback gets the address and length of every segment before it is
+// copied.
+int read_elf_file(const uint8_t *buffer, size_t size, uint8_t *data,
+                  size_t chip_size, int64_t offset,
+                  void (*progress)(void *, size_t, size_t), void *ctx) {
+  elf_t elf = {buffer, 0, 0};
+  uint64_t phoff;
+  size_t phentsize, phnum, i;
+
+  if (!is_elf_data(buffer, size)) return NOT_ELF;
+  if ((buffer[4] != ELFCLASS32 && buffer[4] != ELFCLASS64) ||
+      (buffer[5] != ELFDATA2LSB && buffer[5] != ELFDATA2MSB)) {
+    fprintf(stderr, "Error: unsupported ELF class or byte order.\n");
+    return EXIT_FAILURE;
+  }
+  elf.is64 = buffer[4] == ELFCLASS64;
+  elf.msb = buffer[5] == ELFDATA2MSB;
+
+  // The program header table
+  if (size < (elf.is64 ? 64 : 52)) {
+    fprintf(stderr, "Error: truncated ELF header.\n");
+    return EXIT_FAILURE;
+  }
+  phoff = elf.is64 ? field(&elf, 32, 8) : field(&elf, 28, 4);
+  phentsize = field(&elf, elf.is64 ? 54 : 42, 2);
+  phnum = field(&elf, elf.is64 ? 56 : 44, 2);
+  if (!phnum) {
+    fprintf(stderr, "Error: the ELF file has no program headers.\n");
+    return EXIT_FAILURE;
+  }
+  if (phentsize < (elf.is64 ? 56u : 32u) || phoff > size ||
+      phnum > (size - phoff) / phentsize) {
+    fprintf(stderr, "Error: bad ELF program header table.\n");
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < phnum; i++) {
+    size_t ph = phoff + i * phentsize;
+    uint64_t p_offset, p_paddr, p_filesz;
+
+    if (field(&elf, ph, 4) != PT_LOAD) continue;
+    if (elf.is64) {
+      p_offset = field(&elf, ph + 8, 8);
+      p_paddr = field(&elf, ph + 24, 8);
+      p_filesz = field(&elf, ph + 32, 8);
+    } else {
+      p_offset = field(&elf, ph + 4, 4);
+      p_paddr = field(&elf, ph + 12, 4);
+      p_filesz = field(&elf, ph + 16, 4);
+    }
+    if (!p_filesz) continue;
+    if (p_offset > size || p_filesz > size - p_offset) {
+      fprintf(stderr, "Error: ELF segment %u past the end of the file.\n",
+              (unsigned)i);
+      return EXIT_FAILURE;
+    }
+
+    int64_t address = (int64_t)p_paddr + offset;
+    if (address < 0 || (uint64_t)address > chip_size ||
+        p_filesz > chip_size - (uint64_t)address) {
+      fprintf(stderr,
+              "Error: ELF segment at 0x%llx (%llu bytes) is outside the "
+              "memory.\n",
+              (unsigned long long)p_paddr, (unsigned long long)p_filesz);
+      return EXIT_FAILURE;
+    }
+    if (progress) progress(ctx, address, p_filesz);
+    memcpy(data + address, buffer + p_offset, p_filesz);
+  }
+  return ELF_FORMAT;
+}
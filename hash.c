@@ -0,0 +1,176 @@
+/*
+ * hash.c - SHA-256 and CRC32 hashes of the memory read.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "minipro.h"
+#include "hash.h"
+
+/* SHA-256 (FIPS 180-4) */
+
+static const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t *state, const uint8_t *p) {
+  uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  for (i = 0; i < 16; i++)
+    w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 |
+           (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+  for (i = 16; i < 64; i++)
+    w[i] = w[i - 16] + w[i - 7] +
+           (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+           (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+  f = state[5];
+  g = state[6];
+  h = state[7];
+  for (i = 0; i < 64; i++) {
+    t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) +
+         k[i] + w[i];
+    t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) +
+         ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+void sha256_init(sha256_t *sha) {
+  static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                      0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                      0x1f83d9ab, 0x5be0cd19};
+  memcpy(sha->state, initial, sizeof(initial));
+  sha->length = 0;
+  sha->used = 0;
+}
+
+void sha256_update(sha256_t *sha, const uint8_t *data, size_t len) {
+  sha->length += len;
+  if (sha->used) {
+    size_t n = 64 - sha->used;
+    if (n > len) n = len;
+    memcpy(sha->block + sha->used, data, n);
+    sha->used += n;
+    data += n;
+    len -= n;
+    if (sha->used < 64) return;
+    sha256_block(sha->state, sha->block);
+    sha->used = 0;
+  }
+  // Whole blocks are hashed in place
+  for (; len >= 64; data += 64, len -= 64) sha256_block(sha->state, data);
+  memcpy(sha->block, data, len);
+  sha->used = len;
+}
+
+void sha256_final(sha256_t *sha, uint8_t digest[SHA256_SIZE]) {
+  uint64_t bits = sha->length * 8;
+  int i;
+
+  sha->block[sha->used++] = 0x80;
+  if (sha->used > 56) {
+    memset(sha->block + sha->used, 0, 64 - sha->used);
+    sha256_block(sha->state, sha->block);
+    sha->used = 0;
+  }
+  memset(sha->block + sha->used, 0, 56 - sha->used);
+  for (i = 0; i < 8; i++) sha->block[56 + i] = bits >> (56 - i * 8);
+  sha256_block(sha->state, sha->block);
+  for (i = 0; i < 32; i++) digest[i] = sha->state[i / 4] >> (24 - i % 4 * 8);
+}
+
+/* Hash sets */
+
+int hash_methods(const char *list) {
+  char name[16];
+  int methods = 0, n;
+
+  while (*list) {
+    if (sscanf(list, "%15[^,]%n", name, &n) != 1) return -1;
+    list += n;
+    if (*list == ',') list++;
+    if (!strcasecmp(name, "sha256"))
+      methods |= HASH_SHA256;
+    else if (!strcasecmp(name, "crc32"))
+      methods |= HASH_CRC32;
+    else
+      return -1;
+  }
+  return methods ? methods : -1;
+}
+
+void hash_init(hash_t *hash, int methods) {
+  hash->methods = methods;
+  hash->crc = 0xFFFFFFFF;
+  sha256_init(&hash->sha256);
+}
+
+void hash_update(hash_t *hash, uint8_t *data, size_t len) {
+  if (hash->methods & HASH_SHA256) sha256_update(&hash->sha256, data, len);
+  if (hash->methods & HASH_CRC32)
+    hash->crc = minipro_crc32(data, len, hash->crc);
+}
+
+void hash_final(hash_t *hash) {
+  if (hash->methods & HASH_SHA256) sha256_final(&hash->sha256, hash->digest);
+  hash->crc = ~hash->crc;
+}
+
+int hash_print(hash_t *hash, FILE *file, const char *name) {
+  if (hash->methods & HASH_SHA256) {
+    int i;
+    fprintf(file, "SHA256 (%s) = ", name);
+    for (i = 0; i < SHA256_SIZE; i++) fprintf(file, "%02x", hash->digest[i]);
+    fprintf(file, "\n");
+  }
+  if (hash->methods & HASH_CRC32)
+    fprintf(file, "CRC32 (%s) = %08x\n", name, hash->crc);
+  return ferror(file) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/*
+ * hash.h - Declarations for hashing the memory read.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Hash algorithms, they can be combined
+enum { HASH_SHA256 = 0x01, HASH_CRC32 = 0x02 };
+
+#define SHA256_SIZE 32
+
+typedef struct sha256_s {
+  uint32_t state[8];
+  uint64_t length;     // bytes hashed
+  uint8_t block[64];   // partial block
+  size_t used;
+} sha256_t;
+
+void sha256_init(sha256_t *sha);
+void sha256_update(sha256_t *sha, const uint8_t *data, size_t len);
+void sha256_final(sha256_t *sha, uint8_t digest[SHA256_SIZE]);
+
+// Running hashes of a stream of blocks
+typedef struct hash_s {
+  int methods;
+  uint32_t crc;  // inverted by hash_final
+  sha256_t sha256;
+  uint8_t digest[SHA256_SIZE];
+} hash_t;
+
+// Parse a comma separated list of algorithms, -1 if one is unknown
+int hash_methods(const char *list);
+
+void hash_init(hash_t *hash, int methods);
+void hash_update(hash_t *hash, uint8_t *data, size_t len);
+void hash_final(hash_t *hash);
+// Print one "ALGORITHM (name) = digest" line per algorithm of a final
+// hash, the tagged format of sha256sum --tag
+int hash_print(hash_t *hash, FILE *file, const char *name);
+
+#endif /* HASH_H_ */
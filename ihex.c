@@ -132,9 +132,14 @@ static int write_record(FILE *file, record_t *record) {
   return EXIT_SUCCESS;
 }
 
-// Read an Intel hex file
-int read_hex_file(uint8_t *buffer, uint8_t *data, size_t *size) {
+// Read an Intel hex file, offset is added to the record addresses. The
+// optional progress callback gets the address and length of every data
+// record before it is copied.
+int read_hex_stream(uint8_t *buffer, uint8_t *data, size_t *size,
+                    int64_t offset, void (*progress)(void *, size_t, size_t),
+                    void *ctx) {
   uint32_t line = 0, uba = 0;
+  int64_t address;
   record_t rec;
   uint8_t eof = 0;
 
@@ -167,11 +172,17 @@ int read_hex_file(uint8_t *buffer, uint8_t *data, size_t *size) {
         }
         switch (rec.type) {
           case IHEX_DATA:
+            address = (int64_t)uba + rec.address + offset;
+            if (address < 0) {
+              fprintf(stderr, "Error on line %u: negative address.\n", line);
+              return EXIT_FAILURE;
+            }
+            if (progress) progress(ctx, address, rec.count);
             // If file data size is bigger than chip size
             // update the new size
-            if (chip_size >= uba + rec.address + rec.count)
+            if (chip_size >= address + rec.count)
               // copy record data
-              memcpy(&(data[uba + rec.address]), rec.data, rec.count);
+              memcpy(&(data[address]), rec.data, rec.count);
             //else
               //*size = (uba + rec.address + rec.count);
             break;
@@ -215,50 +226,117 @@ int read_hex_file(uint8_t *buffer, uint8_t *data, size_t *size) {
   return INTEL_HEX_FORMAT;
 }
 
-// Write an Intel hex file
-int write_hex_file(FILE *file, uint8_t *data, size_t size) {
+int read_hex_file(uint8_t *buffer, uint8_t *data, size_t *size) {
+  return read_hex_stream(buffer, data, size, 0, NULL, NULL);
+}
+
+// Decode count hex digits
+static int hex_field(uint8_t *field, size_t count, uint32_t *value) {
+  size_t i;
+  *value = 0;
+  for (i = 0; i < count; i++) {
+    if (hex(field[i]) > 0x0F) return EXIT_FAILURE;
+    *value = (*value << 4) | hex(field[i]);
+  }
+  return EXIT_SUCCESS;
+}
+
+// Scan the record headers of an Intel hex file without decoding the data.
+// Returns 1 if the data records are sorted by address, 0 if not and -1 if
+// this doesn't look like an Intel hex file.
+int scan_hex_file(uint8_t *buffer) {
+  uint32_t type, address, value, uba = 0, last = 0;
+
+  while ((buffer = (uint8_t *)strchr((char *)buffer, ':'))) {
+    if (hex_field(buffer + 3, 4, &address) || hex_field(buffer + 7, 2, &type))
+      return -1;
+    switch (type) {
+      case IHEX_DATA:
+        if (uba + address < last) return 0;
+        last = uba + address;
+        break;
+      case IHEX_ESA:
+        if (hex_field(buffer + 9, 4, &value)) return -1;
+        uba = value << 4;
+        break;
+      case IHEX_ELA:
+        if (hex_field(buffer + 9, 4, &value)) return -1;
+        uba = value << 16;
+        break;
+      case IHEX_SSA:
+        if (hex_field(buffer + 9, 8, &value)) return -1;
+        uba = ((value >> 16) << 4) + (value & 0xFFFF);
+        break;
+      case IHEX_SLA:
+        if (hex_field(buffer + 9, 8, &value)) return -1;
+        uba = value;
+        break;
+    }
+    buffer++;
+  }
+  return 1;
+}
+
+// Start an Intel hex file of a total byte image placed at base. Images
+// reaching past 64K get extended linear address records.
+void hex_writer_init(hex_writer_t *writer, FILE *file, uint32_t base,
+                     size_t row_size, size_t total) {
+  writer->file = file;
+  writer->base = base;
+  writer->row_size = row_size;
+  writer->uba = (uint64_t)base + total > 65536 ? UINT32_MAX : 0;
+}
+
+// Write the records of size bytes at offset in the image. Parts of the
+// image may be left out, but the data must be written in address order.
+int hex_writer_data(hex_writer_t *writer, uint8_t *data, size_t offset,
+                    size_t size) {
   record_t rec;
-  uint16_t address = 0;
-  uint16_t uba = 0;
+  uint32_t address = writer->base + offset;
   size_t len;
 
-  // if size > 64K insert an extended linear address record
   memset(rec.data, 0x00, sizeof(rec.data));
-  if (size > 65536) {
-    rec.type = IHEX_ELA;
-    rec.count = 0x02;
-    rec.address = 0x00;
-    write_record(file, &rec);
-  }
-
   while (size) {
-    // Write data
-    len = (size > ROW_SIZE ? ROW_SIZE : size);
-    rec.type = IHEX_DATA;
-    rec.count = len;
-    rec.address = address;
-    memcpy(rec.data, data, len);
-    write_record(file, &rec);
-    data += ROW_SIZE;
-    size -= len;
-    address += ROW_SIZE;
-
     // Insert an extended linear address record
-    if (!address && size) {
-      uba++;
+    if ((address & 0xFFFF0000) != writer->uba) {
+      writer->uba = address & 0xFFFF0000;
       rec.type = IHEX_ELA;
       rec.count = 0x02;
       rec.address = 0x00;
-      rec.data[0] = (uint8_t)uba << 8;
-      rec.data[1] = (uint8_t)uba;
-      write_record(file, &rec);
+      rec.data[0] = (uint8_t)(address >> 24);
+      rec.data[1] = (uint8_t)(address >> 16);
+      write_record(writer->file, &rec);
     }
+
+    // Write data, a record doesn't cross a 64K boundary
+    len = size > writer->row_size ? writer->row_size : size;
+    if (len > 0x10000 - (address & 0xFFFF)) len = 0x10000 - (address & 0xFFFF);
+    rec.type = IHEX_DATA;
+    rec.count = len;
+    rec.address = (uint16_t)address;
+    memcpy(rec.data, data, len);
+    write_record(writer->file, &rec);
+    data += len;
+    size -= len;
+    address += len;
   }
+  return EXIT_SUCCESS;
+}
 
-  // Insert EOF record
+// Write the end of file record
+int hex_writer_end(hex_writer_t *writer) {
+  record_t rec;
   rec.type = IHEX_EOF;
   rec.count = 0x00;
   rec.address = 0x00;
-  write_record(file, &rec);
+  write_record(writer->file, &rec);
   return EXIT_SUCCESS;
 }
+
+// Write an Intel hex file
+int write_hex_file(FILE *file, uint8_t *data, size_t size) {
+  hex_writer_t writer;
+  hex_writer_init(&writer, file, 0, ROW_SIZE, size);
+  hex_writer_data(&writer, data, 0, size);
+  return hex_writer_end(&writer);
+}
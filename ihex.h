@@ -24,7 +24,26 @@
 #define INTEL_HEX_FORMAT 0
 #define NOT_IHEX -1
 
+#define IHEX_MAX_ROW 255
+
+// Writes an Intel hex file block by block
+typedef struct hex_writer_s {
+  FILE *file;
+  uint32_t base;    // address of the first image byte in the file
+  size_t row_size;  // data bytes per record
+  uint32_t uba;     // upper address of the last extended address record
+} hex_writer_t;
+
 int read_hex_file(uint8_t *buffer, uint8_t *data, size_t *size);
+int read_hex_stream(uint8_t *buffer, uint8_t *data, size_t *size,
+                    int64_t offset, void (*progress)(void *, size_t, size_t),
+                    void *ctx);
+int scan_hex_file(uint8_t *buffer);
 int write_hex_file(FILE *file, uint8_t *data, size_t size);
+void hex_writer_init(hex_writer_t *writer, FILE *file, uint32_t base,
+                     size_t row_size, size_t total);
+int hex_writer_data(hex_writer_t *writer, uint8_t *data, size_t offset,
+                    size_t size);
+int hex_writer_end(hex_writer_t *writer);
 
 #endif
@@ -0,0 +1,756 @@
+/*
+ * image.c - Input files and the images written or verified.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "compose.h"
+#include "elf.h"
+#include "ihex.h"
+#include "image.h"
+#include "image_cache.h"
+#include "main.h"
+#include "srec.h"
+#include "transform.h"
+
+#ifndef _WIN32
+// Length of a mapping of size bytes followed by at least one zero byte
+static size_t map_length(size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  return (size / page + 1) * page;
+}
+#endif
+
+// Map a regular file read-only. The file is mapped over an anonymous
+// mapping one page longer, so the data is always followed by zeros, even
+// if the file size is a multiple of the page size.
+int map_file(const char *filename, size_t size, file_data_t *file) {
+#ifdef _WIN32
+  return EXIT_FAILURE;
+#else
+  size_t len = map_length(size);
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return EXIT_FAILURE;
+
+  uint8_t *map =
+      mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED ||
+      mmap(map, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+          MAP_FAILED) {
+    if (map != MAP_FAILED) munmap(map, len);
+    close(fd);
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  // Images are read once, front to back
+  madvise(map, size, MADV_SEQUENTIAL);
+  file->data = map;
+  file->size = size;
+  file->mapped = 1;
+  return EXIT_SUCCESS;
+#endif
+}
+
+void free_file(file_data_t *file) {
+#ifndef _WIN32
+  if (file->mapped)
+    munmap(file->data, map_length(file->size));
+  else
+#endif
+    free(file->data);
+  file->data = NULL;
+}
+
+// Replace compressed file contents with the decompressed data
+static int inflate_file(file_data_t *contents) {
+  file_data_t plain = {NULL, 0, 0};
+  int method = compress_detect(contents->data, contents->size);
+
+  if (!method) return EXIT_SUCCESS;
+  int ret = decompress_all(method, contents->data, contents->size,
+                           &plain.data, &plain.size);
+  free_file(contents);
+  if (ret) return EXIT_FAILURE;
+  if (!plain.size) {
+    fprintf(stderr, "No data to read.\n");
+    free(plain.data);
+    return EXIT_FAILURE;
+  }
+  *contents = plain;
+  return EXIT_SUCCESS;
+}
+
+// Read a whole physical file, or stdin if filename is NULL.
+// Regular files are mapped, anything else is read in memory.
+// Compressed files are decompressed.
+int read_input(const char *filename, file_data_t *contents) {
+  FILE *file;
+  struct stat st;
+
+  memset(contents, 0, sizeof(file_data_t));
+  // Check if we are dealing with a pipe.
+  if (!filename) {
+    file = stdin;
+    st.st_size = 0;
+  } else {
+    if (!stat(filename, &st) && S_ISREG(st.st_mode) && st.st_size &&
+        !map_file(filename, st.st_size, contents))
+      return inflate_file(contents);
+    file = fopen(filename, "rb");
+    int ret = stat(filename, &st);
+    if (!file || ret) {
+      fprintf(stderr, "Could not open file %s for reading.\n", filename);
+      perror("");
+      if (file) fclose(file);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Allocate a zero initialized buffer.
+  // If the file size is unknown (pipe) a default size will be used.
+  uint8_t *buffer = calloc((st.st_size ? st.st_size : READ_BUFFER_SIZE) + 1, 1);
+  if (!buffer) {
+    fclose(file);
+    fprintf(stderr, "Out of memory!\n");
+    return EXIT_FAILURE;
+  }
+
+  // Try to read the whole file.
+  // If we are reading from stdin  data will be read in small chunks of 64K
+  // each untill EOF.
+  size_t br = 0;
+  size_t sz = READ_BUFFER_SIZE;
+  if (!st.st_size) {
+    size_t ch;
+    uint8_t *tmp;
+    while (br < UINT32_MAX) {
+      ch = fread(buffer + br, 1, READ_BUFFER_SIZE, file);
+      br += ch;
+      if (ch != READ_BUFFER_SIZE) break;
+      sz += READ_BUFFER_SIZE;
+      tmp = realloc(buffer, sz + 1);
+      if (!tmp) {
+        free(buffer);
+        fclose(file);
+        fprintf(stderr, "Out of memory!\n");
+        return EXIT_FAILURE;
+      }
+      buffer = tmp;
+    }
+    buffer[br] = 0;
+  } else
+    br = fread(buffer, 1, st.st_size, file);
+
+  fclose(file);
+  if(!br){
+	  fprintf(stderr, "No data to read.\n");
+	  free(buffer);
+	  return EXIT_FAILURE;
+  }
+  contents->data = buffer;
+  contents->size = br;
+  return inflate_file(contents);
+}
+
+// Read the file given on the command line, or stdin if the pipe character
+// is specified
+static int read_file(minipro_handle_t *handle, file_data_t *contents) {
+  return read_input(handle->cmdopts->is_pipe ? NULL : handle->cmdopts->filename,
+                    contents);
+}
+
+// Parse the contents of a file read by read_file into data
+static int parse_file(minipro_handle_t *handle, uint8_t *buffer, size_t br,
+                      uint8_t *data, size_t *file_size) {
+  // If we are dealing with a jed file just return the data.
+  if (is_pld(handle->device->protocol_id)) {
+    memcpy(data, buffer, br);
+    *file_size = br;
+    return EXIT_SUCCESS;
+  }
+
+  size_t chip_size = *file_size;
+  *file_size = br;
+
+  // Probe for an ELF file
+  int ret = read_elf_file(buffer, br, data, chip_size, 0, NULL, NULL);
+  switch (ret) {
+    case NOT_ELF:
+      break;
+    case EXIT_FAILURE:
+      return EXIT_FAILURE;
+    case ELF_FORMAT:
+      *file_size = chip_size;
+      fprintf(stderr, "Found ELF file.\n");
+      return EXIT_SUCCESS;
+  }
+
+  // Probe for an Intel hex file
+  size_t hex_size = chip_size;
+  ret = read_hex_file(buffer, data, &hex_size);
+  switch (ret) {
+    case NOT_IHEX:
+      break;
+    case EXIT_FAILURE:
+      return EXIT_FAILURE;
+      break;
+    case INTEL_HEX_FORMAT:
+      *file_size = hex_size;
+      fprintf(stderr, "Found Intel hex file.\n");
+      return EXIT_SUCCESS;
+  }
+
+  // Probe for a Motorola srec file
+  hex_size = chip_size;
+  ret = read_srec_file(buffer, data, &hex_size);
+  switch (ret) {
+    case NOT_SREC:
+      break;
+    case EXIT_FAILURE:
+      return EXIT_FAILURE;
+      break;
+    case SREC_FORMAT:
+      *file_size = hex_size;
+      fprintf(stderr, "Found Motorola S-Record file.\n");
+      return EXIT_SUCCESS;
+  }
+
+  if (handle->cmdopts->format == IHEX) {
+    fprintf(stderr, "This is not an Intel hex file.\n");
+    return EXIT_FAILURE;
+  }
+  if (handle->cmdopts->format == SREC) {
+    fprintf(stderr, "This is not an S-Record file.\n");
+    return EXIT_FAILURE;
+  }
+  // This must be a binary file
+  memcpy(data, buffer, *file_size > chip_size ? chip_size : *file_size);
+  return EXIT_SUCCESS;
+}
+
+// Opens a physical file or a pipe if the pipe character is specified
+int open_file(minipro_handle_t *handle, uint8_t *data, size_t *file_size) {
+  file_data_t file;
+
+  if (read_file(handle, &file)) return EXIT_FAILURE;
+  int ret = parse_file(handle, file.data, file.size, data, file_size);
+  free_file(&file);
+  return ret;
+}
+
+// The last text image parsed by open_image. Repeated writes and verifies
+// of the same unchanged file (--loop, jobs, daemon) skip the file parsing.
+// A file replaced or rewritten since has another inode or file time.
+static struct image_cache_s {
+  char *filename;
+  dev_t dev;
+  ino_t ino;
+  int64_t mtime;
+  off_t size;
+  int format;
+  int64_t offset;
+  size_t chip_size;
+  size_t file_size;
+  uint8_t *data;
+} image_cache;
+
+// Modification time of a file in nanoseconds
+int64_t file_mtime(const struct stat *st) {
+#if defined(_WIN32)
+  return st->st_mtime * 1000000000LL;
+#elif defined(__APPLE__)
+  return st->st_mtimespec.tv_sec * 1000000000LL + st->st_mtimespec.tv_nsec;
+#else
+  return st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+#endif
+}
+
+// Probe for a text (hex/srec) image
+int is_text_data(const uint8_t *data, size_t size) {
+  size_t i;
+  for (i = 0; i < size && (data[i] == '\r' || data[i] == '\n'); i++)
+    ;
+  return i < size && (data[i] == ':' || data[i] == 'S');
+}
+
+// Probe for a text image without loading the file
+static int is_text_image(FILE *file) {
+  int c;
+  do {
+    c = fgetc(file);
+  } while (c == '\r' || c == '\n');
+  rewind(file);
+  return c == ':' || c == 'S';
+}
+
+static void parse_progress(void *ctx, size_t address, size_t len) {
+  (void)len;
+  image_t *image = ctx;
+  if (image->sorted) watermark_set(&image->loaded, address);
+}
+
+static void *parse_image(void *arg) {
+  image_t *image = arg;
+  size_t size = image->size;
+  int ret;
+
+  if (image->format == IHEX) {
+    ret = read_hex_stream(image->text.data, image->buffer, &size,
+                          image->offset, parse_progress, image);
+    if (ret == NOT_IHEX) fprintf(stderr, "\nMalformed Intel hex file.\n");
+  } else {
+    ret = read_srec_stream(image->text.data, image->buffer, &size,
+                           image->offset, parse_progress, image);
+    if (ret == NOT_SREC) fprintf(stderr, "\nMalformed S-Record file.\n");
+  }
+  image->load_result = ret ? EXIT_FAILURE : EXIT_SUCCESS;
+  free_file(&image->text);
+  // Release everything, the result is read once this is seen
+  watermark_set(&image->loaded, SIZE_MAX);
+  return NULL;
+}
+
+// Binary images have no addresses to move
+static int binary_offset(image_t *image) {
+  if (!image->offset) return EXIT_SUCCESS;
+  fprintf(stderr,
+          "--offset only applies to Intel hex, S-Record and ELF files.\n");
+  return EXIT_FAILURE;
+}
+
+// Load an image from the file contents into a buffer pre-filled with 0xFF.
+// ELF files are loaded by the physical address of their segments. Hex and
+// S-Record files are handed to the parser thread, with the file
+// size and record order taken from a quick scan of the record headers.
+// The image owns the file contents from here.
+static int load_image(minipro_handle_t *handle, image_t *image,
+                      file_data_t *text) {
+  uint8_t *p;
+  int sorted = -1;
+
+  image->buffer = malloc(image->size);
+  if (!image->buffer) {
+    free_file(text);
+    fprintf(stderr, "Out of memory!\n");
+    return EXIT_FAILURE;
+  }
+  memset(image->buffer, 0xFF, image->size);
+  image->data = image->buffer;
+
+  // ELF segments are copied right away, straight from the file contents
+  if (is_elf_data(text->data, text->size)) {
+    fprintf(stderr, "Found ELF file.\n");
+    int ret = read_elf_file(text->data, text->size, image->buffer,
+                            image->size, image->offset, NULL, NULL);
+    free_file(text);
+    if (ret) {
+      free(image->buffer);
+      image->buffer = NULL;
+    }
+    return ret;
+  }
+
+  for (p = text->data; *p == '\r' || *p == '\n'; p++)
+    ;
+  if (*p == ':') {
+    image->format = IHEX;
+    sorted = scan_hex_file(text->data);
+  } else if (*p == 'S') {
+    image->format = SREC;
+    sorted = scan_srec_file(text->data, &image->file_size, image->offset);
+  }
+
+  // Anything else is parsed right away
+  if (sorted == -1) {
+    if (binary_offset(image)) {
+      free_file(text);
+      free(image->buffer);
+      image->buffer = NULL;
+      return EXIT_FAILURE;
+    }
+    image->file_size = image->size;
+    int ret = parse_file(handle, text->data, text->size, image->buffer,
+                         &image->file_size);
+    free_file(text);
+    if (ret) {
+      free(image->buffer);
+      image->buffer = NULL;
+    }
+    return ret;
+  }
+
+  fprintf(stderr, image->format == IHEX ? "Found Intel hex file.\n"
+                                        : "Found Motorola S-Record file.\n");
+  image->text = *text;
+  image->sorted = sorted;
+  watermark_init(&image->loaded, 0);
+  if (pthread_create(&image->loader, NULL, parse_image, image)) {
+    fprintf(stderr, "Could not start the parser thread.\n");
+    watermark_free(&image->loaded);
+    free_file(&image->text);
+    free(image->buffer);
+    image->buffer = NULL;
+    return EXIT_FAILURE;
+  }
+  image->loading = 1;
+  return EXIT_SUCCESS;
+}
+
+// Decompress a raw binary image. Data past the memory size is only
+// counted.
+static void *inflate_image(void *arg) {
+  image_t *image = arg;
+  uint8_t overflow[READ_BUFFER_SIZE];
+  size_t len, produced, done = 0;
+  int ret;
+
+  do {
+    if (done < image->size) {
+      len = image->size - done;
+      if (len > READ_BUFFER_SIZE) len = READ_BUFFER_SIZE;
+      ret = decompress_read(image->stream, image->buffer + done, len,
+                            &produced);
+      if (!ret) watermark_set(&image->loaded, done + produced);
+    } else
+      ret = decompress_read(image->stream, overflow, sizeof(overflow),
+                            &produced);
+    done += produced;
+  } while (!ret && produced);
+  decompress_close(image->stream);
+  image->stream = NULL;
+  free_file(&image->text);
+
+  // The size recorded in the file was already checked against the chip
+  if (!ret && image->file_size && done != image->file_size) {
+    fprintf(stderr, "\nThe decompressed image size doesn't match the "
+                    "size recorded in the file.\n");
+    ret = EXIT_FAILURE;
+  }
+  image->inflated = done;
+  image->load_result = ret;
+  watermark_set(&image->loaded, SIZE_MAX);
+  return NULL;
+}
+
+// Load a compressed image. Text images are decompressed in memory and
+// parsed, raw binary images are decompressed on the loader thread.
+static int load_compressed(minipro_handle_t *handle, image_t *image,
+                           file_data_t *file, int method) {
+  uint8_t head[256];
+  size_t produced;
+
+  // Peek at the start of the data for the format
+  decompress_t *stream = decompress_open(method, file->data, file->size);
+  if (!stream || decompress_read(stream, head, sizeof(head), &produced)) {
+    decompress_close(stream);
+    free_file(file);
+    return EXIT_FAILURE;
+  }
+  decompress_close(stream);
+  if (!produced) {
+    fprintf(stderr, "No data to read.\n");
+    free_file(file);
+    return EXIT_FAILURE;
+  }
+  if (is_text_data(head, produced) || is_elf_data(head, produced)) {
+    if (inflate_file(file)) return EXIT_FAILURE;
+    return load_image(handle, image, file);
+  }
+
+  fprintf(stderr, "Found %s compressed image.\n", compress_name(method));
+  if (binary_offset(image)) {
+    free_file(file);
+    return EXIT_FAILURE;
+  }
+  image->buffer = malloc(image->size);
+  image->stream = decompress_open(method, file->data, file->size);
+  if (!image->buffer || !image->stream) {
+    if (!image->buffer) fprintf(stderr, "Out of memory!\n");
+    decompress_close(image->stream);
+    free(image->buffer);
+    image->buffer = NULL;
+    free_file(file);
+    return EXIT_FAILURE;
+  }
+  memset(image->buffer, 0xFF, image->size);
+  image->data = image->buffer;
+  image->text = *file;
+  image->file_size = decompress_size(method, file->data, file->size);
+  watermark_init(&image->loaded, 0);
+  if (pthread_create(&image->loader, NULL, inflate_image, image)) {
+    fprintf(stderr, "Could not start the decompression thread.\n");
+    watermark_free(&image->loaded);
+    decompress_close(image->stream);
+    free_file(&image->text);
+    free(image->buffer);
+    image->buffer = NULL;
+    return EXIT_FAILURE;
+  }
+  image->loading = 1;
+
+  // The size is needed before writing
+  if (!image->file_size) {
+    watermark_wait(&image->loaded, SIZE_MAX);
+    image->file_size = image->inflated;
+  }
+  return EXIT_SUCCESS;
+}
+
+// Open the image of a size bytes memory. Without a file name the image
+// is blank (all 0xFF).
+int open_image(minipro_handle_t *handle, image_t *image, size_t size) {
+  file_data_t file;
+
+  memset(image, 0, sizeof(image_t));
+  image->size = size;
+  image->chip_size = size;
+  image->file_size = size;
+  if (!handle->cmdopts->filename) return EXIT_SUCCESS;
+  image->transform = handle->cmdopts->transform;
+  image->offset = handle->cmdopts->offset;
+  if (handle->cmdopts->is_pipe) {
+    if (read_file(handle, &file)) return EXIT_FAILURE;
+    return load_image(handle, image, &file);
+  }
+  if (is_composed_image(handle->cmdopts->filename))
+    return compose_image(image, handle->cmdopts->filename);
+
+  if (stat(handle->cmdopts->filename, &image->st)) {
+    fprintf(stderr, "Could not open file %s for reading.\n",
+            handle->cmdopts->filename);
+    perror("");
+    return EXIT_FAILURE;
+  }
+  if (image_cache.filename &&
+      !strcmp(image_cache.filename, handle->cmdopts->filename) &&
+      image_cache.dev == image->st.st_dev &&
+      image_cache.ino == image->st.st_ino &&
+      image_cache.mtime == file_mtime(&image->st) &&
+      image_cache.size == image->st.st_size &&
+      image_cache.format == handle->cmdopts->format &&
+      image_cache.chip_size == size && image_cache.offset == image->offset) {
+    image->data = image_cache.data;
+    image->file_size = image_cache.file_size;
+    return EXIT_SUCCESS;
+  }
+
+  image->cacheable = 1;
+#ifndef _WIN32
+  if (handle->cmdopts->image_cache &&
+      !load_cached_image(image, handle->cmdopts->filename,
+                         handle->cmdopts->format))
+    return EXIT_SUCCESS;
+#endif
+
+  // Text images and forced formats are parsed in memory
+  if (handle->cmdopts->format == IHEX || handle->cmdopts->format == SREC) {
+    if (read_file(handle, &file)) return EXIT_FAILURE;
+    return load_image(handle, image, &file);
+  }
+  if (!image->st.st_size) {
+    fprintf(stderr, "No data to read.\n");
+    return EXIT_FAILURE;
+  }
+
+  // Binary images are written straight from the mapping
+  if (S_ISREG(image->st.st_mode) &&
+      !map_file(handle->cmdopts->filename, image->st.st_size, &file)) {
+    int method = compress_detect(file.data, file.size);
+    if (method) return load_compressed(handle, image, &file, method);
+    if (is_text_data(file.data, file.size) ||
+        is_elf_data(file.data, file.size))
+      return load_image(handle, image, &file);
+    if (binary_offset(image)) {
+      free_file(&file);
+      return EXIT_FAILURE;
+    }
+    image->map = file;
+    image->file_size = file.size;
+    return EXIT_SUCCESS;
+  }
+
+  image->file = fopen(handle->cmdopts->filename, "rb");
+  if (!image->file) {
+    fprintf(stderr, "Could not open file %s for reading.\n",
+            handle->cmdopts->filename);
+    perror("");
+    return EXIT_FAILURE;
+  }
+  uint8_t magic[4];
+  size_t len = fread(magic, 1, sizeof(magic), image->file);
+  rewind(image->file);
+  if (compress_detect(magic, len) || is_elf_data(magic, len) ||
+      is_text_image(image->file)) {
+    fclose(image->file);
+    image->file = NULL;
+    if (read_file(handle, &file)) return EXIT_FAILURE;
+    return load_image(handle, image, &file);
+  }
+  if (binary_offset(image)) {
+    fclose(image->file);
+    image->file = NULL;
+    return EXIT_FAILURE;
+  }
+  image->file_size = image->st.st_size;
+  return EXIT_SUCCESS;
+}
+
+// Copy [offset, offset + len) of an image into block, padding with 0xFF
+// past the end of the image data
+static int read_source(image_t *image, uint8_t *block, size_t offset,
+                       size_t len) {
+  size_t avail = offset < image->file_size ? image->file_size - offset : 0;
+  if (avail > len) avail = len;
+
+  if (image->map.data) {
+    memcpy(block, image->map.data + offset, avail);
+  } else if (image->file && avail) {
+    if (offset != image->position &&
+        fseek(image->file, offset, SEEK_SET)) {
+      fprintf(stderr, "\nError reading the image file.\n");
+      return EXIT_FAILURE;
+    }
+    if (fread(block, 1, avail, image->file) != avail) {
+      fprintf(stderr, "\nError reading the image file.\n");
+      return EXIT_FAILURE;
+    }
+    image->position = offset + avail;
+  } else if (image->data) {
+    // Wait for the loader to complete the block
+    if (image->loading) {
+      watermark_wait(&image->loaded, offset + len);
+      if (atomic_load(&image->loaded.value) == SIZE_MAX &&
+          image->load_result)
+        return EXIT_FAILURE;
+    }
+    // Parsed images are already padded up to the chip size
+    avail = len;
+    memcpy(block, image->data + offset, len);
+  } else
+    avail = 0;
+  memset(block + avail, 0xFF, len - avail);
+
+  if (image->patch) {
+    size_t i;
+    for (i = 0; i < image->patch->count; i++)
+      if (image->patch->address[i] >= offset &&
+          image->patch->address[i] < offset + len)
+        block[image->patch->address[i] - offset] = image->patch->value[i];
+  }
+  return EXIT_SUCCESS;
+}
+
+// Copy [offset, offset + len) of the chip's memory into block. For a ROM
+// set the lanes of the chip are picked out of the set image.
+static int read_lanes(image_t *image, uint8_t *block, size_t offset,
+                      size_t len) {
+  split_t *split = image->split;
+  if (!split) return read_source(image, block, offset, len);
+
+  size_t start, span;
+  if (split_range(split, image->chip_size, offset, len, &start, &span))
+    return EXIT_FAILURE;
+  if (span > image->gather_size) {
+    uint8_t *gather = realloc(image->gather, span);
+    if (!gather) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    image->gather = gather;
+    image->gather_size = span;
+  }
+  if (read_source(image, image->gather, start, span)) return EXIT_FAILURE;
+  split_gather(split, image->gather, block, offset, len);
+  return EXIT_SUCCESS;
+}
+
+// Copy [offset, offset + len) of the chip's memory into block, in the
+// byte and bit order of the chip
+int read_image(image_t *image, uint8_t *block, size_t offset, size_t len) {
+  if (read_lanes(image, block, offset, len)) return EXIT_FAILURE;
+  transform_block(block, len, image->transform);
+  return EXIT_SUCCESS;
+}
+
+void close_image(minipro_handle_t *handle, image_t *image) {
+  if (image->loading) {
+    pthread_join(image->loader, NULL);
+    watermark_free(&image->loaded);
+    if (image->load_result) {
+      free(image->buffer);
+      image->buffer = NULL;
+    }
+  }
+  if (image->file) fclose(image->file);
+  if (image->map.data) free_file(&image->map);
+  if (image->cached.data) free_file(&image->cached);
+  free(image->gather);
+
+#ifndef _WIN32
+  if (image->buffer && image->cacheable && handle->cmdopts->image_cache)
+    store_cached_image(image, handle->cmdopts->filename,
+                       handle->cmdopts->format,
+                       (uint64_t)handle->cmdopts->image_cache << 20);
+#endif
+
+  // The cache takes over the buffer of a loaded image
+  if (image->buffer && image->cacheable) {
+    free(image_cache.filename);
+    free(image_cache.data);
+    image_cache.data = NULL;
+    image_cache.filename = strdup(handle->cmdopts->filename);
+    if (image_cache.filename) {
+      image_cache.data = image->buffer;
+      image_cache.dev = image->st.st_dev;
+      image_cache.ino = image->st.st_ino;
+      image_cache.mtime = file_mtime(&image->st);
+      image_cache.size = image->st.st_size;
+      image_cache.format = handle->cmdopts->format;
+      image_cache.offset = image->offset;
+      image_cache.chip_size = image->size;
+      image_cache.file_size = image->file_size;
+      image->buffer = NULL;
+    }
+  }
+  free(image->buffer);
+  memset(image, 0, sizeof(image_t));
+}
+
+// Check the image size against the memory size
+int check_image_size(minipro_handle_t *handle, image_t *image) {
+  if (image->file_size == image->size) return EXIT_SUCCESS;
+  if (!handle->cmdopts->size_error) {
+    fprintf(stderr,
+            "Incorrect file size: %" PRI_SIZET " (needed %" PRI_SIZET ", use -s/S to ignore)\n",
+            image->file_size, image->size);
+    return EXIT_FAILURE;
+  } else if (handle->cmdopts->size_nowarn == 0)
+    fprintf(stderr,
+            "Warning: Incorrect file size: %" PRI_SIZET " (needed %" PRI_SIZET
+            ")\n",
+            image->file_size, image->size);
+  return EXIT_SUCCESS;
+}
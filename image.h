@@ -0,0 +1,116 @@
+/*
+ * image.h - Definitions and declarations for the input files and the
+ *		images written or verified.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include "compress.h"
+#include "minipro.h"
+#include "pipeline.h"
+#include "split.h"
+
+#define READ_BUFFER_SIZE 65536
+#define PATCH_MAX_SIZE 9
+
+// The contents of an input file, zero terminated for the text parsers
+typedef struct file_data_s {
+  uint8_t *data;
+  size_t size;
+  uint8_t mapped;
+} file_data_t;
+
+// Bytes laid over an image as it is read: a serial number and its
+// checksum
+typedef struct patch_s {
+  size_t address[PATCH_MAX_SIZE];
+  uint8_t value[PATCH_MAX_SIZE];
+  size_t count;
+} patch_t;
+
+// An image to be written or verified. Raw binary files are mapped, or
+// read block by block where they can't be, so they need no memory of the
+// size of the chip. Intel hex, S-Record and ELF files, compressed files
+// and pipes are loaded into memory; hex and S-Record files are parsed and
+// compressed binary files decompressed on a separate thread while the
+// device is erased and written. The segments of ELF files are copied from
+// the mapping right away.
+typedef struct image_s {
+  FILE *file;         // raw binary image
+  size_t position;    // current offset in file
+  file_data_t map;    // mapped raw binary image
+  uint8_t *data;      // parsed image, NULL for a blank check
+  uint8_t *buffer;    // data owned by the image
+  size_t size;        // memory size of the image, of the whole ROM set
+  size_t chip_size;   // memory size of the chip
+  size_t file_size;   // size of the image data
+  struct stat st;     // image file status, for the cache
+  uint8_t cacheable;
+  patch_t *patch;     // bytes replaced in the image, may be NULL
+  split_t *split;     // the chip's share of a ROM set image, may be NULL
+  uint8_t *gather;    // set image data of a split block
+  size_t gather_size;
+  int transform;      // byte and bit order of the chip
+  file_data_t cached; // mapped entry of the image cache on disk
+  int64_t offset;     // added to the hex/srec file addresses
+
+  // Loader thread, parsing or decompressing the image
+  uint8_t loading;
+  uint8_t format;     // IHEX or SREC
+  uint8_t sorted;     // blocks can be released before the parse is done
+  file_data_t text;   // file contents being parsed or decompressed
+  decompress_t *stream;
+  size_t inflated;    // decompressed size
+  int load_result;
+  pthread_t loader;
+  watermark_t loaded;  // the image data below is final
+} image_t;
+
+// Map a regular file read-only, followed by zeros
+int map_file(const char *filename, size_t size, file_data_t *file);
+void free_file(file_data_t *file);
+
+// Read a whole file, or stdin if filename is NULL, decompressing it
+int read_input(const char *filename, file_data_t *contents);
+
+// Read the file given on the command line into data. file_size holds the
+// memory size on entry and the file data size on return.
+int open_file(minipro_handle_t *handle, uint8_t *data, size_t *file_size);
+
+// Modification time of a file in nanoseconds
+int64_t file_mtime(const struct stat *st);
+
+// Probe for an Intel hex or S-Record file
+int is_text_data(const uint8_t *data, size_t size);
+
+// Open the image of the file given on the command line for a size bytes
+// memory, blank without a file name
+int open_image(minipro_handle_t *handle, image_t *image, size_t size);
+
+// Copy [offset, offset + len) of the chip's memory into block
+int read_image(image_t *image, uint8_t *block, size_t offset, size_t len);
+void close_image(minipro_handle_t *handle, image_t *image);
+
+// Check the image size against the memory size
+int check_image_size(minipro_handle_t *handle, image_t *image);
+
+#endif /* IMAGE_H_ */
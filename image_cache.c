@@ -0,0 +1,205 @@
+/*
+ * image_cache.c - Cache of the parsed images on disk.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "image_cache.h"
+
+#ifndef _WIN32
+// A cache entry: this header, the path of the image file and the parsed
+// image padded to the memory size. Entries are named after a hash of the
+// path and the memory size; the inode, the file time in nanoseconds, the
+// size and the -f format in the header tell a changed file. Used entries are touched, so the oldest file times go
+// first when the cache is over its size limit.
+typedef struct cache_entry_s {
+  char magic[8];
+  int64_t mtime;       // in nanoseconds
+  uint64_t size;       // image file size
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t chip_size;
+  uint64_t file_size;  // size of the image data
+  int64_t offset;      // --offset of the parse
+  uint32_t format;     // -f format of the parse
+  uint32_t path_len;
+  uint32_t data_offset;
+} cache_entry_t;
+
+typedef struct cache_file_s {
+  char *name;
+  time_t mtime;
+  off_t size;
+} cache_file_t;
+
+// Name of the cache entry of an image file for a memory size and offset
+static char *cache_entry_name(const char *dir, const char *path,
+                              size_t chip_size, int64_t offset) {
+  uint64_t hash = 0xcbf29ce484222325ULL;  // FNV-1a
+  const char *p;
+  size_t i;
+
+  for (p = path; *p; p++) hash = (hash ^ (uint8_t)*p) * 0x100000001b3ULL;
+  for (i = 0; i < sizeof(chip_size); i++)
+    hash = (hash ^ (uint8_t)(chip_size >> (i * 8))) * 0x100000001b3ULL;
+  for (i = 0; i < sizeof(offset); i++)
+    hash = (hash ^ (uint8_t)((uint64_t)offset >> (i * 8))) * 0x100000001b3ULL;
+  char *name = malloc(strlen(dir) + 22);
+  if (name) sprintf(name, "%s/%016llx.img", dir, (unsigned long long)hash);
+  return name;
+}
+
+// Map the cached parse of the image file, if there is a valid one
+int load_cached_image(image_t *image, const char *filename, int format) {
+  struct stat st;
+  cache_entry_t header;
+  int ret = EXIT_FAILURE;
+
+  char *dir = minipro_cache_dir();
+  char *path = realpath(filename, NULL);
+  char *name = dir && path ? cache_entry_name(dir, path, image->size, image->offset)
+                          : NULL;
+  if (name && !stat(name, &st) && (size_t)st.st_size > sizeof(header) &&
+      !map_file(name, st.st_size, &image->cached)) {
+    memcpy(&header, image->cached.data, sizeof(header));
+    if (!memcmp(header.magic, IMAGE_CACHE_MAGIC, sizeof(header.magic)) &&
+        header.mtime == file_mtime(&image->st) &&
+        header.size == (uint64_t)image->st.st_size &&
+        header.dev == (uint64_t)image->st.st_dev &&
+        header.ino == (uint64_t)image->st.st_ino &&
+        header.format == (uint32_t)format &&
+        header.chip_size == image->size && header.offset == image->offset &&
+        header.file_size <= image->size &&
+        header.path_len == strlen(path) &&
+        header.data_offset >= sizeof(header) + header.path_len &&
+        header.data_offset + image->size <= (size_t)st.st_size &&
+        !memcmp(image->cached.data + sizeof(header), path,
+                header.path_len)) {
+      image->data = image->cached.data + header.data_offset;
+      image->file_size = header.file_size;
+      // Most recently used
+      utimes(name, NULL);
+      ret = EXIT_SUCCESS;
+    } else
+      free_file(&image->cached);
+  }
+  free(name);
+  free(path);
+  free(dir);
+  return ret;
+}
+
+static int compare_cache_files(const void *a, const void *b) {
+  const cache_file_t *x = a, *y = b;
+  return x->mtime < y->mtime ? -1 : x->mtime > y->mtime;
+}
+
+// Remove the least recently used entries until the cache fits its limit
+static void evict_cached_images(const char *dir, uint64_t limit) {
+  cache_file_t *files = NULL, *tmp;
+  size_t count = 0, capacity = 0, i;
+  uint64_t total = 0;
+  struct dirent *entry;
+  struct stat st;
+
+  DIR *d = opendir(dir);
+  if (!d) return;
+  while ((entry = readdir(d))) {
+    size_t len = strlen(entry->d_name);
+    if (len < 4 || strcmp(entry->d_name + len - 4, ".img")) continue;
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      tmp = realloc(files, capacity * sizeof(cache_file_t));
+      if (!tmp) break;
+      files = tmp;
+    }
+    files[count].name = malloc(strlen(dir) + len + 2);
+    if (!files[count].name) break;
+    sprintf(files[count].name, "%s/%s", dir, entry->d_name);
+    if (stat(files[count].name, &st)) {
+      free(files[count].name);
+      continue;
+    }
+    files[count].mtime = st.st_mtime;
+    files[count].size = st.st_size;
+    total += st.st_size;
+    count++;
+  }
+  closedir(d);
+
+  qsort(files, count, sizeof(cache_file_t), compare_cache_files);
+  for (i = 0; i < count; i++) {
+    if (total > limit && !remove(files[i].name)) total -= files[i].size;
+    free(files[i].name);
+  }
+  free(files);
+}
+
+// Save a freshly parsed image in the cache. The entry is written under a
+// temporary name and renamed, so a reader never maps a partial entry.
+void store_cached_image(image_t *image, const char *filename, int format,
+                        uint64_t limit) {
+  cache_entry_t header;
+  uint8_t pad[8] = {0};
+
+  char *dir = minipro_cache_dir();
+  char *path = realpath(filename, NULL);
+  char *name = dir && path ? cache_entry_name(dir, path, image->size, image->offset)
+                          : NULL;
+  char *temp = name ? malloc(strlen(name) + 16) : NULL;
+  if (!temp || image->size + sizeof(header) > limit) goto cleanup;
+  sprintf(temp, "%s.%d", name, (int)getpid());
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, IMAGE_CACHE_MAGIC, sizeof(header.magic));
+  header.mtime = file_mtime(&image->st);
+  header.size = image->st.st_size;
+  header.dev = image->st.st_dev;
+  header.ino = image->st.st_ino;
+  header.format = format;
+  header.chip_size = image->size;
+  header.file_size = image->file_size;
+  header.offset = image->offset;
+  header.path_len = strlen(path);
+  header.data_offset = (sizeof(header) + header.path_len + 7) & ~7;
+
+  FILE *file = fopen(temp, "wb");
+  if (!file) goto cleanup;
+  int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(path, 1, header.path_len, file) == header.path_len &&
+           fwrite(pad, 1, header.data_offset - sizeof(header) -
+                              header.path_len, file) ==
+               header.data_offset - sizeof(header) - header.path_len &&
+           fwrite(image->buffer, 1, image->size, file) == image->size;
+  if (fclose(file) || !ok || rename(temp, name)) {
+    remove(temp);
+    goto cleanup;
+  }
+  evict_cached_images(dir, limit);
+
+cleanup:
+  free(temp);
+  free(name);
+  free(path);
+  free(dir);
+}
+#endif
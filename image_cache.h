@@ -0,0 +1,36 @@
+/*
+ * image_cache.h - Declarations for the cache of the parsed images on disk.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef IMAGE_CACHE_H_
+#define IMAGE_CACHE_H_
+
+#include <stdint.h>
+#include "image.h"
+
+#define IMAGE_CACHE_LIMIT 256
+#define IMAGE_CACHE_MAGIC "MPIMAGE2"
+
+// Map the cached parse of the image file with the -f format into
+// image->data, if there is a valid one. Not available on Windows.
+int load_cached_image(image_t *image, const char *filename, int format);
+
+// Save the parsed image of the file, then remove the least recently used
+// entries until the cache fits in limit bytes
+void store_cached_image(image_t *image, const char *filename, int format,
+                        uint64_t limit);
+
+#endif /* IMAGE_CACHE_H_ */
@@ -0,0 +1,486 @@
+/*
+ * job.c - Job files, the production loop and the daemon mode.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include "compress.h"
+#include "job.h"
+#include "main.h"
+#include "transform.h"
+
+#define DAEMON_BACKLOG 16
+#define DAEMON_TIMEOUT 30
+#define LOOP_POLL_INTERVAL 200000
+#define LOOP_SETTLE 3
+
+static struct {
+  const char *name;
+  int action;
+  uint8_t needs_arg;
+  uint8_t has_page;
+} job_actions[] = {
+    {"device", JOB_DEVICE, 1, 0},
+    {"option", JOB_OPTION, 1, 0},
+    {"id", NO_ACTION, 0, 0},
+    {"erase", ERASE, 0, 0},
+    {"blank_check", BLANK_CHECK, 0, 1},
+    {"read", READ, 1, 1},
+    {"write", WRITE, 1, 1},
+    {"verify", VERIFY, 1, 1},
+    {NULL, 0, 0, 0}};
+
+// Apply a job option, named like the long command line option
+static int set_job_option(cmdopts_t *cmdopts, const char *name) {
+  if (!strcmp(name, "skip_erase"))
+    cmdopts->no_erase = 1;
+  else if (!strcmp(name, "skip_verify"))
+    cmdopts->no_verify = 1;
+  else if (!strcmp(name, "no_size_error"))
+    cmdopts->size_error = 1;
+  else if (!strcmp(name, "no_size_warning"))
+    cmdopts->size_error = cmdopts->size_nowarn = 1;
+  else if (!strcmp(name, "no_id_error"))
+    cmdopts->idcheck_continue = 1;
+  else if (!strcmp(name, "no_write_protect"))
+    cmdopts->no_protect_on = 1;
+  else if (!strcmp(name, "write_protect"))
+    cmdopts->no_protect_off = 1;
+  else if (!strcmp(name, "compress"))
+    cmdopts->compress = COMPRESS_GZIP;
+  else if (!strcmp(name, "swap16"))
+    cmdopts->transform |= TRANSFORM_SWAP16;
+  else if (!strcmp(name, "swap32"))
+    cmdopts->transform |= TRANSFORM_SWAP32;
+  else if (!strcmp(name, "bitreverse"))
+    cmdopts->transform |= TRANSFORM_BITREVERSE;
+  else
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
+
+void free_job(job_t *job) {
+  size_t i;
+  for (i = 0; i < job->count; i++) {
+    free(job->steps[i].text);
+    free(job->steps[i].arg);
+  }
+  free(job->steps);
+  job->steps = NULL;
+  job->count = 0;
+}
+
+int parse_job_file(FILE *file, const char *name, job_t *job, FILE *out) {
+  char line[1024], word[3][1024];
+  int line_number = 0, error = 0;
+  cmdopts_t options;
+
+  memset(&options, 0, sizeof(options));
+  memset(job, 0, sizeof(*job));
+  job->out = out;
+  while (!error && fgets(line, sizeof(line), file)) {
+    line_number++;
+    line[strcspn(line, "\r\n")] = 0;
+    int words = sscanf(line, "%1023s %1023s %1023s", word[0], word[1], word[2]);
+    if (words < 1 || word[0][0] == '#') continue;
+    if (!strcasecmp(word[0], "end")) break;
+
+    job_step_t step;
+    memset(&step, 0, sizeof(step));
+    step.line = line_number;
+    step.page = UNSPECIFIED;
+    int i;
+    for (i = 0; job_actions[i].name; i++)
+      if (!strcasecmp(word[0], job_actions[i].name)) break;
+    if (!job_actions[i].name) {
+      fprintf(out, "%s:%d: unknown job action '%s'\n", name, line_number,
+              word[0]);
+      error = 1;
+      break;
+    }
+    step.action = job_actions[i].action;
+
+    int arg_words = 1;
+    if (job_actions[i].needs_arg) {
+      if (words < 2 || !strcmp(word[1], "-")) {
+        fprintf(out, "%s:%d: '%s' requires an argument\n", name,
+                line_number, word[0]);
+        error = 1;
+        break;
+      }
+      if (step.action == JOB_OPTION && set_job_option(&options, word[1])) {
+        fprintf(out, "%s:%d: unknown option '%s'\n", name, line_number,
+                word[1]);
+        error = 1;
+        break;
+      }
+      arg_words = 2;
+    }
+    if (words > arg_words && job_actions[i].has_page) {
+      if (!strcasecmp(word[arg_words], "code"))
+        step.page = CODE;
+      else if (!strcasecmp(word[arg_words], "data"))
+        step.page = DATA;
+      else if (!strcasecmp(word[arg_words], "config"))
+        step.page = CONFIG;
+      else {
+        fprintf(out, "%s:%d: unknown page type '%s'\n", name, line_number,
+                word[arg_words]);
+        error = 1;
+        break;
+      }
+      arg_words++;
+    }
+    if (words > arg_words) {
+      fprintf(out, "%s:%d: too many arguments\n", name, line_number);
+      error = 1;
+      break;
+    }
+
+    job_step_t *steps =
+        realloc(job->steps, (job->count + 1) * sizeof(job_step_t));
+    if (steps) job->steps = steps;
+    step.text = strdup(line);
+    if (job_actions[i].needs_arg) step.arg = strdup(word[1]);
+    if (!steps || !step.text || (job_actions[i].needs_arg && !step.arg)) {
+      fprintf(out, "Out of memory\n");
+      free(step.text);
+      free(step.arg);
+      error = 1;
+      break;
+    }
+    job->steps[job->count++] = step;
+  }
+  // A read error or timeout must not run the steps received so far
+  if (!error && ferror(file)) {
+    fprintf(out, "Error reading job %s: %s\n", name, strerror(errno));
+    error = 1;
+  }
+
+  if (error) {
+    free_job(job);
+    return EXIT_FAILURE;
+  }
+  if (!job->count) {
+    fprintf(out, "Job %s is empty.\n", name);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int parse_job(const char *path, job_t *job) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "Could not open job file %s.\n", path);
+    perror("");
+    return EXIT_FAILURE;
+  }
+  int ret = parse_job_file(file, path, job, stderr);
+  fclose(file);
+  return ret;
+}
+
+int run_job(minipro_handle_t *handle, job_t *job) {
+  cmdopts_t *cmdopts = handle->cmdopts;
+  uint64_t begin = get_usec();
+  size_t i;
+  int ret = EXIT_SUCCESS;
+
+  for (i = 0; i < job->count && !ret; i++) {
+    job_step_t *step = &job->steps[i];
+    fprintf(job->out, "Step %" PRI_SIZET "/%" PRI_SIZET ": %s\n", i + 1,
+            job->count, step->text);
+
+    if (step->action == JOB_DEVICE) {
+      ret = select_device(handle, step->arg);
+    } else if (step->action == JOB_OPTION) {
+      ret = set_job_option(cmdopts, step->arg);
+    } else if (!handle->device) {
+      fprintf(job->out, "No device selected.\n");
+      ret = EXIT_FAILURE;
+    } else if (step->action == NO_ACTION) {
+      // An explicit ID step fails on mismatch or if there's no chip ID
+      uint8_t idcheck_only = cmdopts->idcheck_only;
+      cmdopts->idcheck_only = 1;
+      ret = check_chip_id(handle);
+      cmdopts->idcheck_only = idcheck_only;
+    } else {
+      cmdopts->action = step->action;
+      cmdopts->page = step->page;
+      cmdopts->filename = step->arg;
+      cmdopts->is_pipe = 0;
+      // The -o options only apply to writes, so they are set per step
+      if (step->action == WRITE && apply_options(handle)) {
+        fprintf(job->out, "Invalid programming options for %s.\n",
+                handle->device->name);
+        ret = EXIT_FAILURE;
+      } else
+        ret = run_action(handle);
+      if (minipro_end_transaction(handle)) ret = EXIT_FAILURE;
+    }
+    if (ret)
+      fprintf(job->out, "Job step %" PRI_SIZET " (line %d) failed.\n", i + 1,
+              step->line);
+  }
+  if (!ret)
+    fprintf(job->out, "Job completed in %.2fSec\n",
+            (get_usec() - begin) / 1000000.0);
+  cmdopts->action = NO_ACTION;
+  return ret;
+}
+
+/* Production loop */
+
+// Set by SIGINT/SIGTERM in the loop and daemon modes
+static volatile sig_atomic_t stop_requested = 0;
+
+static void stop_signal(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+// Poll the ZIF socket until the chip reaches the wanted state. A seated
+// chip must be seen LOOP_SETTLE times in a row to ride out contact bounce.
+static int wait_for_chip(minipro_handle_t *handle, uint8_t wanted) {
+  uint8_t status;
+  int seen = 0;
+
+  while (!stop_requested) {
+    if (minipro_chip_present(handle, &status)) return EXIT_FAILURE;
+    if (status == wanted) {
+      if (wanted != MP_CHIP_PRESENT || ++seen >= LOOP_SETTLE)
+        return EXIT_SUCCESS;
+    } else
+      seen = 0;
+    usleep(LOOP_POLL_INTERVAL);
+  }
+  return EXIT_SUCCESS;
+}
+
+static void print_set_chip(split_t *split) {
+  fprintf(stderr, "Chip %" PRI_SIZET "/%" PRI_SIZET " of the set (lane %" PRI_SIZET
+          ", bank %" PRI_SIZET ")\n",
+          split->chip + 1, split->count, split->chip % split->lanes + 1,
+          split->chip / split->lanes + 1);
+}
+
+int run_loop(minipro_handle_t *handle, job_t *job, split_t *split) {
+  cmdopts_t defaults = *handle->cmdopts;
+  unsigned int chips = 0, failed = 0;
+
+  if (!handle->minipro_chip_present || handle->icsp) {
+    fprintf(stderr, "Chip detection is not supported for %s on the %s.\n",
+            handle->device->name, handle->model);
+    return EXIT_FAILURE;
+  }
+
+  signal(SIGINT, stop_signal);
+  signal(SIGTERM, stop_signal);
+  while (!stop_requested) {
+    fprintf(stderr, "Waiting for a chip...\n");
+    if (wait_for_chip(handle, MP_CHIP_PRESENT)) return EXIT_FAILURE;
+    if (stop_requested) break;
+
+    chips++;
+    uint64_t begin = get_usec();
+    *handle->cmdopts = defaults;
+    // The chips of a ROM set are expected in turn
+    if (split && split->only < 0) {
+      split->chip = (chips - 1) % split->count;
+      print_set_chip(split);
+    }
+    int ret = check_chip_id(handle);
+    if (!ret) ret = job->count ? run_job(handle, job) : run_action(handle);
+    if (minipro_end_transaction(handle)) ret = EXIT_FAILURE;
+    if (ret) failed++;
+    fprintf(stderr, "Chip %u: %s (%.2fSec)\n", chips, ret ? "FAILED" : "PASSED",
+            (get_usec() - begin) / 1000000.0);
+
+    fprintf(stderr, "Remove the chip.\n");
+    if (wait_for_chip(handle, MP_CHIP_ABSENT)) return EXIT_FAILURE;
+  }
+  fprintf(stderr, "%u chips, %u passed, %u failed\n", chips, chips - failed,
+          failed);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int run_split(minipro_handle_t *handle, split_t *split) {
+  cmdopts_t defaults = *handle->cmdopts;
+  int detect = handle->minipro_chip_present && !handle->icsp;
+  int ret = EXIT_SUCCESS, c;
+
+  signal(SIGINT, stop_signal);
+  signal(SIGTERM, stop_signal);
+  for (split->chip = 0; split->chip < split->count; split->chip++) {
+    if (split->chip) {
+      if (minipro_end_transaction(handle)) return EXIT_FAILURE;
+      if (detect) {
+        fprintf(stderr, "Remove the chip.\n");
+        if (wait_for_chip(handle, MP_CHIP_ABSENT)) return EXIT_FAILURE;
+        fprintf(stderr, "Insert the next chip.\n");
+        if (wait_for_chip(handle, MP_CHIP_PRESENT)) return EXIT_FAILURE;
+      } else {
+        fprintf(stderr, "Insert the next chip and press Enter.\n");
+        while ((c = getchar()) != EOF && c != '\n')
+          ;
+        if (c == EOF) stop_requested = 1;
+      }
+      if (stop_requested) {
+        fprintf(stderr, "Interrupted, the set is incomplete.\n");
+        return EXIT_FAILURE;
+      }
+      *handle->cmdopts = defaults;
+    }
+    print_set_chip(split);
+    if (split->chip) ret = check_chip_id(handle);
+    if (!ret) ret = run_action(handle);
+    if (ret) {
+      fprintf(stderr, "Chip %" PRI_SIZET " of the set failed.\n",
+              split->chip + 1);
+      return ret;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+#ifndef _WIN32
+/* Daemon mode */
+
+// Only clients running as the user of the daemon are served
+static int check_peer(int client) {
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &len)) return 0;
+  return cred.uid == geteuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  if (getpeereid(client, &uid, &gid)) return 0;
+  return uid == geteuid();
+#endif
+}
+
+int run_daemon(minipro_handle_t *handle, const char *path) {
+  cmdopts_t defaults = *handle->cmdopts;
+  struct sockaddr_un addr;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path %s is too long.\n", path);
+    return EXIT_FAILURE;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0) {
+    perror("socket");
+    return EXIT_FAILURE;
+  }
+  unlink(path);
+  // Create the socket file with no access for other users
+  mode_t mask = umask(077);
+  int error = bind(server, (struct sockaddr *)&addr, sizeof(addr));
+  umask(mask);
+  if (error || listen(server, DAEMON_BACKLOG)) {
+    fprintf(stderr, "Could not listen on %s: %s\n", path, strerror(errno));
+    close(server);
+    return EXIT_FAILURE;
+  }
+
+  // Let accept() return on SIGINT/SIGTERM; a running job is finished first
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stop_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  unsigned int jobs = 0;
+  fprintf(stderr, "Waiting for jobs on %s\n", path);
+  while (!stop_requested) {
+    int client = accept(server, NULL, NULL);
+    if (client < 0) {
+      if (errno == EINTR) continue;
+      perror("accept");
+      break;
+    }
+    if (!check_peer(client)) {
+      fprintf(stderr, "Refused a client of another user.\n");
+      close(client);
+      continue;
+    }
+    struct timeval timeout = {DAEMON_TIMEOUT, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // The connection is read and written through separate streams
+    FILE *in = fdopen(client, "r");
+    if (!in) {
+      close(client);
+      continue;
+    }
+    int client_out = dup(client);
+    FILE *out = client_out < 0 ? NULL : fdopen(client_out, "w");
+    if (!out) {
+      if (client_out >= 0) close(client_out);
+      fclose(in);
+      continue;
+    }
+    setvbuf(out, NULL, _IOLBF, 0);
+
+    job_t job;
+    *handle->cmdopts = defaults;
+    fprintf(stderr, "Job %u received\n", jobs + 1);
+    int ret = parse_job_file(in, "job", &job, out);
+    if (!ret) {
+      if (job.steps[0].action != JOB_DEVICE) {
+        if (handle->device)
+          ret = select_device(handle, handle->device->name);
+        else {
+          fprintf(out, "No device selected.\n");
+          ret = EXIT_FAILURE;
+        }
+      }
+      if (!ret) ret = run_job(handle, &job);
+      free_job(&job);
+    }
+    minipro_end_transaction(handle);
+    fprintf(out, "%s\n", ret ? "FAILED" : "OK");
+    fclose(out);
+    fclose(in);
+    fprintf(stderr, "Job %u %s\n", ++jobs, ret ? "failed" : "completed");
+  }
+
+  close(server);
+  unlink(path);
+  return EXIT_SUCCESS;
+}
+#endif
@@ -0,0 +1,77 @@
+/*
+ * job.h - Definitions and declarations for the job files, the
+ *		production loop and the daemon mode.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef JOB_H_
+#define JOB_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include "minipro.h"
+#include "split.h"
+
+// Job steps besides the actions
+enum { JOB_DEVICE = -1, JOB_OPTION = -2 };
+
+// One line of a job file
+typedef struct job_step_s {
+  int line;
+  int action;
+  int page;
+  char *arg;
+  char *text;
+} job_step_t;
+
+typedef struct job_s {
+  job_step_t *steps;
+  size_t count;
+  FILE *out;  // step and result messages: stderr, or the daemon client
+} job_t;
+
+// Parse a job until the end of the stream or an 'end' line. Every other
+// non-empty line is one step:
+//   <action> [<argument>] [code|data|config]
+// Lines starting with '#' are comments. Errors are printed to out, which
+// is kept as the message stream of the job.
+int parse_job_file(FILE *file, const char *name, job_t *job, FILE *out);
+int parse_job(const char *path, job_t *job);
+void free_job(job_t *job);
+
+// Run all job steps in one programmer session, stopping at the first
+// failed step.
+int run_job(minipro_handle_t *handle, job_t *job);
+
+// Run the action or job for every chip seated in the socket until
+// interrupted. The chips of a ROM set are expected in turn.
+int run_loop(minipro_handle_t *handle, job_t *job, split_t *split);
+
+// Write or verify every chip of a ROM set in one session. The next chip
+// is taken when the programmer detects it, or else when Enter is pressed.
+int run_split(minipro_handle_t *handle, split_t *split);
+
+#ifndef _WIN32
+// Serve jobs from a Unix domain socket, one client at a time. A client
+// sends a job (see parse_job_file) terminated by an 'end' line or by
+// shutting down its side of the connection. The step messages of the job
+// are sent back on the connection, followed by a final "OK" or "FAILED"
+// line; the detailed messages go to the daemon's stderr. The socket is
+// only accessible to the user of the daemon, and a client that stalls for
+// DAEMON_TIMEOUT seconds is dropped.
+int run_daemon(minipro_handle_t *handle, const char *path);
+#endif
+
+#endif /* JOB_H_ */
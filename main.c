@@ -27,30 +27,85 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include <getopt.h>
 #include <unistd.h>
 
+#include "compose.h"
+#include "compress.h"
+#include "hash.h"
 #include "database.h"
 #include "jedec.h"
 #include "ihex.h"
 #include "srec.h"
+#include "elf.h"
+#include "image.h"
+#include "image_cache.h"
+#include "job.h"
+#include "main.h"
 #include "minipro.h"
+#include "operations.h"
+#include "pipeline.h"
+#include "serial.h"
+#include "split.h"
+#include "transform.h"
 #include "version.h"
 
 #ifdef _WIN32
 	#include <shlwapi.h>
 	#define STRCASESTR StrStrIA
-	#define PRI_SIZET  "Iu"
 #else
 	#define STRCASESTR strcasestr
-	#define PRI_SIZET  "zu"
 #endif
 
 #define VPP_VOLTAGE 0
 #define VCC_VOLTAGE 1
 
-#define READ_BUFFER_SIZE 65536
+#define BENCHMARK_PASSES 5
+#define CHECKPOINT_EXT ".ckpt"
+#define CHECKPOINT_INTERVAL 0x10000
+#define VERIFY_STRIDE 16
+
+// Long options without a short equivalent
+enum {
+  OPT_BENCHMARK = 0x100,
+  OPT_BENCHMARK_WRITE,
+  OPT_CHECKPOINT,
+  OPT_RESUME,
+  OPT_JOB,
+  OPT_DAEMON,
+  OPT_LOOP,
+  OPT_COMPRESS,
+  OPT_VERIFY_MODE,
+  OPT_SERIAL,
+  OPT_SPLIT,
+  OPT_SWAP16,
+  OPT_SWAP32,
+  OPT_BITREVERSE,
+  OPT_IMAGE_CACHE,
+  OPT_OFFSET,
+  OPT_UNFILL,
+  OPT_OBS,
+  OPT_LINE_LENGTH,
+  OPT_HASH,
+  OPT_USB,
+};
+
+// Per-block latency samples collected while benchmarking
+typedef struct bench_s {
+  const char *name;
+  uint32_t *samples;  // block latencies in microseconds
+  size_t count;
+  size_t capacity;
+  uint64_t bytes;  // bytes transferred
+  uint64_t usec;   // total time spent in the block loops
+} bench_t;
+
+static bench_t *bench = NULL;
 
+static serial_t *serial = NULL;
+
+static split_t *split = NULL;
 
 const char *get_voltage(minipro_handle_t*, uint8_t, uint8_t);
 
@@ -108,12 +163,35 @@ static struct option long_options[] = {
     {"write_protect", no_argument, NULL, 'u'},
     {"hardware_check", no_argument, NULL, 't'},
     {"update", required_argument, NULL, 'F'},
+    {"benchmark", optional_argument, NULL, OPT_BENCHMARK},
+    {"benchmark_write", no_argument, NULL, OPT_BENCHMARK_WRITE},
+    {"checkpoint", no_argument, NULL, OPT_CHECKPOINT},
+    {"resume", no_argument, NULL, OPT_RESUME},
+    {"job", required_argument, NULL, OPT_JOB},
+    {"daemon", required_argument, NULL, OPT_DAEMON},
+    {"loop", no_argument, NULL, OPT_LOOP},
+    {"compress", optional_argument, NULL, OPT_COMPRESS},
+    {"verify_mode", required_argument, NULL, OPT_VERIFY_MODE},
+    {"serial", required_argument, NULL, OPT_SERIAL},
+    {"split", required_argument, NULL, OPT_SPLIT},
+    {"swap16", no_argument, NULL, OPT_SWAP16},
+    {"swap32", no_argument, NULL, OPT_SWAP32},
+    {"bitreverse", no_argument, NULL, OPT_BITREVERSE},
+    {"image_cache", optional_argument, NULL, OPT_IMAGE_CACHE},
+    {"offset", required_argument, NULL, OPT_OFFSET},
+    {"unfill", required_argument, NULL, OPT_UNFILL},
+    {"obs", required_argument, NULL, OPT_OBS},
+    {"line_length", required_argument, NULL, OPT_LINE_LENGTH},
+    {"line-length", required_argument, NULL, OPT_LINE_LENGTH},
+    {"hash", required_argument, NULL, OPT_HASH},
+    {"usb", required_argument, NULL, OPT_USB},
     {"help", no_argument, NULL, 'h'},
     {NULL, 0, NULL, 0}};
 
-void print_version_and_exit() {
+void print_version_and_exit(cmdopts_t *cmdopts) {
   fprintf(stderr, "Supported programmers: TL866A/CS, TL866II+\n");
-  minipro_handle_t *handle = minipro_open(NULL, VERBOSE);
+  minipro_handle_t *handle = minipro_open_programmer(NULL, cmdopts->usb,
+                                                     VERBOSE);
   if (handle) {
     minipro_print_system_info(handle);
     if (handle->status == MP_STATUS_BOOTLOADER) {
@@ -144,11 +222,16 @@ void print_help_and_exit(char *progname) {
       "  --query_supported	-Q		Query supported programmers\n"
       "  --presence_check	-k		Query programmer version\n"
       "					currently connected.\n"
+      "  --usb <location|serial>	Use the programmer at this USB\n"
+      "					<bus>:<address> or with this serial\n"
+      "					number (put it before -V and -t)\n"
       "  --get_info		-d <device>	Show device information\n"
       "  --get_id		-D		Just read the chip ID\n"
       "  --read		-r <filename>	Read memory\n"
       "  --write		-w <filename>	Write memory\n"
       "  --verify		-m <filename>	Verify memory\n"
+      "					<file>[@<offset>],... merges several\n"
+      "					files into one image for -w and -m\n"
       "  --format		-f <format>	Specify file format\n"
       "					Possible values: ihex, srec\n"
       "  --blank_check		-b		Blank check.\n"
@@ -162,6 +245,10 @@ void print_help_and_exit(char *progname) {
       "  --write_protect	-u 		Do NOT disable write-protect\n"
       "  --no_write_protect	-P 		Do NOT enable write-protect\n"
       "  --skip_verify		-v		Do NOT verify after write\n"
+      "  --verify_mode <mode>		How to verify: full (default),\n"
+      "					checksum (CRC32 and byte sum only),\n"
+      "					sample[:<n>] (every nth block) or\n"
+      "					device (programmer verify only)\n"
       "  --device		-p <device>	Specify device (use quotes)\n"
       "  --page		-c <type>	Specify memory type (optional)\n"
       "					Possible values: code, data, config\n"
@@ -193,6 +280,38 @@ void print_help_and_exit(char *progname) {
       "  --hardware_check	-t		Start hardware check\n"
       "  --update		-F <filename>	Update firmware\n"
       "					(should be update.dat or updateII.dat)\n"
+      "  --benchmark[=<passes>]		Measure read throughput and block\n"
+      "					latency (default 5 passes)\n"
+      "  --benchmark_write			Also run write/verify cycles\n"
+      "					(destroys the chip contents!)\n"
+      "  --checkpoint			Save the read/write progress to\n"
+      "					<filename>.ckpt (binary reads only)\n"
+      "  --resume			Continue an interrupted checkpointed\n"
+      "					read or write\n"
+      "  --job <filename>		Run the steps of a job file in one\n"
+      "					session (see the manual page)\n"
+      "  --daemon <socket>		Serve jobs from a Unix domain socket\n"
+      "  --loop				Repeat -w/-m/-b/-E or the job for every\n"
+      "					chip inserted (TL866II+ only)\n"
+      "  --serial <spec>		Patch a serial number into every chip\n"
+      "					written (see the manual page)\n"
+      "  --split <spec>		Write or verify a 16/32-bit ROM set,\n"
+      "					one chip after the other (see the\n"
+      "					manual page)\n"
+      "  --swap16			Swap the bytes of every 16-bit word\n"
+      "  --swap32			Swap the bytes of every 32-bit word\n"
+      "  --bitreverse			Reverse the bits of every byte\n"
+      "  --image_cache[=<MiB>]		Keep parsed hex/srec images on disk\n"
+      "					(default limit 256 MiB)\n"
+      "  --offset <n>			Add n to the hex/srec file addresses\n"
+      "  --unfill <byte>[,<n>]		Leave runs of at least n bytes (1)\n"
+      "					out of the hex/srec file read\n"
+      "  --obs <n>			Data bytes per hex/srec record\n"
+      "  --line_length <n>		Maximum hex/srec line length\n"
+      "  --hash <list>			Hash the memory read, to stderr and\n"
+      "					<file>.hash: sha256, crc32\n"
+      "  --compress[=<method>]		Compress the file read\n"
+      "					Possible values: gzip (default), zstd\n"
       "  --help		-h		Show help (this text)\n";
   fprintf(stderr, usage, VERSION, basename(progname));
   exit(EXIT_FAILURE);
@@ -230,7 +349,8 @@ minipro_handle_t *get_handle(const char *device_name, cmdopts_t *cmdopts) {
       }
     }
   } else if (!cmdopts->version) {
-    minipro_handle_t *tmp = minipro_open(NULL, VERBOSE);
+    minipro_handle_t *tmp = minipro_open_programmer(NULL, cmdopts->usb,
+                                                    VERBOSE);
     if (!tmp) {
       free(handle);
       return NULL;
@@ -268,65 +388,6 @@ int is_pld(uint8_t protocol_id) {
   return 0;
 }
 
-//Helper function to check for PIC devices
-int is_pic(minipro_handle_t *handle) {
-  if(handle->version == MP_TL866A) {
-    switch (handle->device->protocol_id) {
-      case TL866A_PIC_PROTOCOL_1:
-      case TL866A_PIC_PROTOCOL_2:
-      case TL866A_PIC_PROTOCOL_3:
-      case TL866A_PIC_PROTOCOL_4:
-      case TL866A_PIC_PROTOCOL_PIC18:
-      case TL866A_PIC_PROTOCOL_PIC18_ICSP:
-        return 1;
-    }
-  }
-  else if(handle->version == MP_TL866IIPLUS) {
-    switch (handle->device->protocol_id) {
-      case TL866IIP_PIC_PROTOCOL_1:
-      case TL866IIP_PIC_PROTOCOL_2:
-      case TL866IIP_PIC_PROTOCOL_3:
-      case TL866IIP_PIC_PROTOCOL_4:
-      case TL866IIP_PIC_PROTOCOL_PIC18:
-      case TL866IIP_PIC_PROTOCOL_PIC18_ICSP:
-        return 1;
-    }
-  }
-  return 0;
-}
-
-size_t get_pic_word_width(minipro_handle_t *handle) {
-  if(is_pic(handle)) {
-    switch(handle->device->opts7 & PIC_INSTR_WORD_WIDTH_MASK) {
-      case PIC_INSTR_WORD_WIDTH_12:
-        return 12;
-        break;
-
-      case PIC_INSTR_WORD_WIDTH_14:
-        return 14;
-        break;
-
-      case PIC_INSTR_WORD_WIDTH_16_PIC18F:
-      case PIC_INSTR_WORD_WIDTH_16_PIC18J:
-        return 16;
-        break;
-    }
-  }
-
-  return 0;  
-}
-
-// will return 0 when mask doesn't require masked compare
-uint16_t get_compare_mask(minipro_handle_t *handle, uint8_t type) {
-  if(type == MP_CODE) { // only code memory, not data memory
-    size_t wordlen = get_pic_word_width(handle);
-    if(wordlen > 0 && wordlen < 16)
-      return (0xffffUL >> (16-wordlen));
-  }
-  
-  return 0;
-}
-
 void print_one_device(device_t *dev) {
     fprintf(stdout, "%s\n", dev->name);
     fflush(stdout);
@@ -337,25 +398,37 @@ void print_supported_programmers_and_exit() {
   exit(EXIT_SUCCESS);
 }
 
+// List every connected programmer with its usb location and serial number
 void print_connected_programmer_and_exit() {
-  minipro_handle_t *handle = minipro_open(NULL, NO_VERBOSE);
-  if (!handle) {
+  int count = minipro_get_devices_count(MP_TL866A) +
+              minipro_get_devices_count(MP_TL866IIPLUS);
+  int i;
+  if (!count) {
     fprintf(stderr, "[No programmer found]\n");
-  } else {
+    exit(EXIT_SUCCESS);
+  }
+  for (i = 0; i < count; i++) {
+    minipro_handle_t *handle = minipro_open_index(i, NO_VERBOSE);
+    if (!handle) {
+      fprintf(stderr, "[Programmer in use]\n");
+      continue;
+    }
     switch (handle->version) {
       case MP_TL866A:
-        fprintf(stderr, "tl866a: TL866A\n");
+        fprintf(stderr, "tl866a: TL866A");
         break;
       case MP_TL866CS:
-        fprintf(stderr, "tl866a: TL866CS\n");
+        fprintf(stderr, "tl866a: TL866CS");
         break;
       case MP_TL866IIPLUS:
-        fprintf(stderr, "tl866ii: TL866II+\n");
+        fprintf(stderr, "tl866ii: TL866II+");
         break;
       default:
-        fprintf(stderr, "[Unknown programmer version]\n");
+        fprintf(stderr, "[Unknown programmer version]");
     }
-    free(handle);
+    fprintf(stderr, " at %s, serial %s\n", handle->location,
+            handle->serial_number);
+    minipro_close(handle);
   }
   exit(EXIT_SUCCESS);
 }
@@ -532,7 +605,7 @@ int set_voltage(minipro_handle_t *handle, char *value, int *target,
 // Parse and set programming options for both TL866A/CS and TL866II+
 int parse_options(minipro_handle_t *handle, int argc, char **argv) {
   uint32_t v;
-  int8_t c;
+  int c;
   char *p_end, option[64], value[64];
   int vpp = -1, vcc = -1, vdd = -1, pulse_delay = -1, opt_idx = 0;
 
@@ -638,8 +711,9 @@ int parse_options(minipro_handle_t *handle, int argc, char **argv) {
   return EXIT_SUCCESS;
 }
 
-void hardware_check_and_exit() {
-  minipro_handle_t *handle = minipro_open(NULL, VERBOSE);
+void hardware_check_and_exit(cmdopts_t *cmdopts) {
+  minipro_handle_t *handle = minipro_open_programmer(NULL, cmdopts->usb,
+                                                     VERBOSE);
   if (!handle) {
     exit(EXIT_FAILURE);
   }
@@ -656,6 +730,14 @@ void hardware_check_and_exit() {
 }
 
 void firmware_update_and_exit(const char *firmware) {
+  // The update waits for the programmer to disappear and reopens the
+  // first one found, so it can't tell several programmers apart.
+  if (minipro_get_devices_count(MP_TL866A) +
+          minipro_get_devices_count(MP_TL866IIPLUS) > 1) {
+    fprintf(stderr,
+            "Disconnect the other programmers to update the firmware.\n");
+    exit(EXIT_FAILURE);
+  }
   minipro_handle_t *handle = minipro_open(NULL, VERBOSE);
   if (!handle) {
     exit(EXIT_FAILURE);
@@ -670,7 +752,8 @@ void firmware_update_and_exit(const char *firmware) {
 
 // Autodetect 25xx SPI devices
 void spi_autodetect_and_exit(uint8_t package_type, cmdopts_t *cmdopts) {
-  minipro_handle_t *handle = minipro_open(NULL, VERBOSE);
+  minipro_handle_t *handle = minipro_open_programmer(NULL, cmdopts->usb,
+                                                     VERBOSE);
   if (!handle) {
     exit(EXIT_FAILURE);
   }
@@ -713,7 +796,8 @@ void spi_autodetect_and_exit(uint8_t package_type, cmdopts_t *cmdopts) {
 }
 
 void parse_cmdline(int argc, char **argv, cmdopts_t *cmdopts) {
-  int8_t c;
+  int c;
+  char *p_end;
   uint8_t package_type = 0;
   void (*list_func)(const char *, cmdopts_t *) = NULL;
   char *name = NULL;
@@ -874,11 +958,11 @@ void parse_cmdline(int argc, char **argv, cmdopts_t *cmdopts) {
         break;
 
       case 'V':
-        print_version_and_exit();
+        print_version_and_exit(cmdopts);
         break;
 
       case 't':
-        hardware_check_and_exit();
+        hardware_check_and_exit(cmdopts);
         break;
 
       /*
@@ -891,6 +975,172 @@ void parse_cmdline(int argc, char **argv, cmdopts_t *cmdopts) {
       case 'F':
         firmware_update_and_exit(optarg);
         break;
+
+      case OPT_BENCHMARK:
+        cmdopts->action = BENCHMARK;
+        cmdopts->bench_passes = BENCHMARK_PASSES;
+        if (optarg) {
+          errno = 0;
+          cmdopts->bench_passes = strtoul(optarg, &p_end, 10);
+          if (p_end == optarg || *p_end || errno || !cmdopts->bench_passes) {
+            fprintf(stderr, "Invalid benchmark pass count (%s).\n", optarg);
+            print_help_and_exit(argv[0]);
+          }
+        }
+        break;
+
+      case OPT_BENCHMARK_WRITE:
+        cmdopts->bench_write = 1;
+        break;
+
+      case OPT_CHECKPOINT:
+        cmdopts->checkpoint = 1;
+        break;
+
+      case OPT_RESUME:
+        cmdopts->checkpoint = 1;
+        cmdopts->resume = 1;
+        break;
+
+      case OPT_JOB:
+        cmdopts->job = optarg;
+        break;
+
+      case OPT_DAEMON:
+        cmdopts->daemon = optarg;
+        break;
+
+      case OPT_LOOP:
+        cmdopts->loop = 1;
+        break;
+
+      case OPT_SERIAL:
+        cmdopts->serial = optarg;
+        break;
+
+      case OPT_SPLIT:
+        cmdopts->split = optarg;
+        break;
+
+      case OPT_SWAP16:
+        cmdopts->transform |= TRANSFORM_SWAP16;
+        break;
+
+      case OPT_SWAP32:
+        cmdopts->transform |= TRANSFORM_SWAP32;
+        break;
+
+      case OPT_BITREVERSE:
+        cmdopts->transform |= TRANSFORM_BITREVERSE;
+        break;
+
+      case OPT_OFFSET:
+        errno = 0;
+        cmdopts->offset = strtoll(optarg, &p_end, 0);
+        if (p_end == optarg || *p_end || errno) {
+          fprintf(stderr, "Invalid offset (%s).\n", optarg);
+          print_help_and_exit(argv[0]);
+        }
+        break;
+
+      case OPT_UNFILL: {
+        unsigned long value, run = 1;
+        errno = 0;
+        value = strtoul(optarg, &p_end, 0);
+        if (p_end != optarg && *p_end == ',') {
+          char *p_run = p_end + 1;
+          run = strtoul(p_run, &p_end, 0);
+          if (p_end == p_run) run = 0;
+        }
+        if (p_end == optarg || *p_end || errno || value > 0xFF || !run) {
+          fprintf(stderr, "Invalid unfill option (%s).\n", optarg);
+          print_help_and_exit(argv[0]);
+        }
+        cmdopts->unfill = 1;
+        cmdopts->unfill_value = value;
+        cmdopts->unfill_run = run;
+        break;
+      }
+
+      case OPT_OBS:
+      case OPT_LINE_LENGTH: {
+        errno = 0;
+        size_t value = strtoul(optarg, &p_end, 0);
+        if (p_end == optarg || *p_end || errno || !value) {
+          fprintf(stderr, "Invalid %s (%s).\n",
+                  c == OPT_OBS ? "output block size" : "line length", optarg);
+          print_help_and_exit(argv[0]);
+        }
+        if (c == OPT_OBS)
+          cmdopts->row_size = value;
+        else
+          cmdopts->line_length = value;
+        break;
+      }
+
+      case OPT_IMAGE_CACHE:
+        cmdopts->image_cache = IMAGE_CACHE_LIMIT;
+        if (optarg) {
+          errno = 0;
+          cmdopts->image_cache = strtoul(optarg, &p_end, 10);
+          if (p_end == optarg || *p_end || errno || !cmdopts->image_cache) {
+            fprintf(stderr, "Invalid image cache size (%s).\n", optarg);
+            print_help_and_exit(argv[0]);
+          }
+        }
+        break;
+
+      case OPT_VERIFY_MODE:
+        if (!strcasecmp(optarg, "full"))
+          cmdopts->verify_mode = VERIFY_FULL;
+        else if (!strcasecmp(optarg, "checksum"))
+          cmdopts->verify_mode = VERIFY_CHECKSUM;
+        else if (!strcasecmp(optarg, "device"))
+          cmdopts->verify_mode = VERIFY_DEVICE;
+        else if (!strncasecmp(optarg, "sample", 6) &&
+                 (!optarg[6] || optarg[6] == ':')) {
+          cmdopts->verify_mode = VERIFY_SAMPLE;
+          cmdopts->verify_stride = VERIFY_STRIDE;
+          if (optarg[6]) {
+            errno = 0;
+            cmdopts->verify_stride = strtoul(optarg + 7, &p_end, 10);
+            if (p_end == optarg + 7 || *p_end || errno ||
+                !cmdopts->verify_stride) {
+              fprintf(stderr, "Invalid sample interval (%s).\n", optarg);
+              print_help_and_exit(argv[0]);
+            }
+          }
+        } else {
+          fprintf(stderr, "Unknown verify mode (%s).\n", optarg);
+          print_help_and_exit(argv[0]);
+        }
+        break;
+
+      case OPT_HASH: {
+        int methods = hash_methods(optarg);
+        if (methods < 0) {
+          fprintf(stderr, "Unknown hash algorithm (%s).\n", optarg);
+          print_help_and_exit(argv[0]);
+        }
+        cmdopts->hash = methods;
+        break;
+      }
+
+      case OPT_USB:
+        cmdopts->usb = optarg;
+        break;
+
+      case OPT_COMPRESS:
+        cmdopts->compress = COMPRESS_GZIP;
+        if (optarg) {
+          int method = compress_method(optarg);
+          if (method < 0) {
+            fprintf(stderr, "Unknown compression method (%s).\n", optarg);
+            print_help_and_exit(argv[0]);
+          }
+          cmdopts->compress = method;
+        }
+        break;
       default:
         print_help_and_exit(argv[0]);
         break;
@@ -965,278 +1215,155 @@ int compare_memory(uint8_t replacement_value, uint8_t *s1, uint8_t *s2, size_t s
   return -1;
 }
 
-// returned value will be a byte offset
-// sizes are in bytes
-// replacement_value needs to be in native byte order
-// sizes can be odd
-int compare_word_memory(uint16_t replacement_value,
-      uint16_t compare_mask, uint8_t little_endian,
-      uint8_t *s1, uint8_t *s2, size_t size1, size_t size2,
-      uint16_t *c1, uint16_t *c2) {
-  size_t i;
-  uint16_t v1, v2;
-  size_t size = (size1 > size2) ? size1 : size2;
-  if(compare_mask == 0) compare_mask = 0xffff;
-  uint8_t rvl =  (replacement_value & compare_mask)       & 0xff;
-  uint8_t rvh = ((replacement_value & compare_mask) >> 8) & 0xff;
+// Intervals must not jump with the wall clock
+uint64_t get_usec(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000 +
+         (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
 
-  for (i = 0; i < size; i +=2 ) {
-    if(little_endian) {
-      v1 = (i < size1) ? s1[i] : rvl;
-      v1 |= (((i + 1) < size1) ? s1[i + 1] : rvh) << 8;
-      v2 = (i < size2) ? s2[i] : rvl;
-      v2 |= (((i + 1) < size2) ? s2[i + 1] : rvh) << 8;
-    }
-    else {
-      v1 = ((i < size1) ? s1[i] : rvh) << 8;
-      v1 |= ((i + 1) < size1) ? (s1[i + 1]) : rvl;
-      v2 = ((i < size2) ? s2[i] : rvh) << 8;
-      v2 |= ((i + 1) < size2) ? (s2[i + 1]) : rvl;
-    }
-    if ((v1 & compare_mask) != (v2 & compare_mask)) {
-      *c1 = v1;
-      *c2 = v2;
-      return i;
-    }
-  }
-  return -1;
+// Record one block latency sample if a benchmark is running
+static void bench_sample(uint64_t begin, size_t len) {
+  if (!bench) return;
+  if (bench->count == bench->capacity) {
+    size_t capacity = bench->capacity ? bench->capacity * 2 : 1024;
+    uint32_t *tmp = realloc(bench->samples, capacity * sizeof(uint32_t));
+    if (!tmp) return;
+    bench->samples = tmp;
+    bench->capacity = capacity;
+  }
+  bench->samples[bench->count++] = (uint32_t)(get_usec() - begin);
+  bench->bytes += len;
+}
+
+// Status line prefix of the running operation
+static char progress_msg[64];
+
+// Progress callback of the library operations
+static void print_progress(void *data, size_t done, size_t total) {
+  static uint64_t last_usec;
+  static size_t last_done;
+  (void)data;
+
+  if (done > last_done) bench_sample(last_usec, done - last_done);
+  last_done = done;
+  last_usec = get_usec();
+  if (done < total)
+    update_status(progress_msg, "%2d%%", done * 100 / total);
+}
+
+// Error callback of the library operations
+static void print_error(void *data, const char *message) {
+  (void)data;
+  fprintf(stderr, "\n%s\n", message);
 }
 
 /* RAM-centric IO operations */
-int read_page_ram(minipro_handle_t *handle, uint8_t *buf, uint8_t type,
-                  size_t size) {
-  char status_msg[64];
-  char *name = type == MP_CODE ? "Code" : "Data";
-  sprintf(status_msg, "Reading %s...  ", name);
 
-  size_t blocks_count = size / handle->device->read_buffer_size;
-  if (size % handle->device->read_buffer_size) blocks_count++;
+// Read every stride-th block of a memory range, and the last one
+int read_page_sampled(minipro_handle_t *handle, uint8_t type, size_t start,
+                      size_t size, size_t stride, minipro_block_cb consume,
+                      void *ctx) {
+  char *name = type == MP_CODE ? "Code" : "Data";
+  sprintf(progress_msg, "Reading %s...  ", name);
 
   struct timeval begin, end;
   gettimeofday(&begin, NULL);
-  uint32_t address;
-  size_t i, len = handle->device->read_buffer_size;
-  for (i = 0; i < blocks_count; i++) {
-    update_status(status_msg, "%2d%%", i * 100 / blocks_count);
-    // Translating address to protocol-specific
-    address = i * handle->device->read_buffer_size;
-    if ((handle->device->opts4 & MP_DATA_BUS_WIDTH) && type == MP_CODE)
-      address = address >> 1;
-
-    if (minipro_read_block(handle, type, address,
-                           buf + i * handle->device->read_buffer_size, len))
-      return EXIT_FAILURE;
-
-    uint8_t ovc;
-    if (minipro_get_ovc_status(handle, NULL, &ovc)) return EXIT_FAILURE;
-    if (ovc) {
-      fprintf(stderr, "\nOvercurrent protection!\007\n");
-      return EXIT_FAILURE;
-    }
-  }
+  if (minipro_read_sampled(handle, type, start, size, stride, consume, ctx))
+    return EXIT_FAILURE;
   gettimeofday(&end, NULL);
-  sprintf(status_msg, "Reading %s...  %.2fSec  OK", name,
+  sprintf(progress_msg, "Reading %s...  %.2fSec  OK", name,
           (double)(end.tv_usec - begin.tv_usec) / 1000000 +
               (double)(end.tv_sec - begin.tv_sec));
-  update_status(status_msg, "\n");
+  update_status(progress_msg, "\n");
   return EXIT_SUCCESS;
 }
 
-int write_page_ram(minipro_handle_t *handle, uint8_t *buffer, uint8_t type,
-                   size_t size) {
-  char status_msg[64];
-  char *name = type == MP_CODE ? "Code" : "Data";
-  sprintf(status_msg, "Writing  %s...  ", name);
+// Read a memory range block by block, handing every block to a callback.
+// The start offset must be a multiple of the device read buffer size.
+int read_page_stream(minipro_handle_t *handle, uint8_t type, size_t start,
+                     size_t size, minipro_block_cb consume, void *ctx) {
+  return read_page_sampled(handle, type, start, size, 1, consume, ctx);
+}
 
-  size_t blocks_count = size / handle->device->write_buffer_size;
-  if (size % handle->device->write_buffer_size) blocks_count++;
+static int copy_block(void *ctx, uint8_t *block, size_t offset, size_t len) {
+  memcpy((uint8_t *)ctx + offset, block, len);
+  return EXIT_SUCCESS;
+}
 
-  struct timeval begin, end;
-  gettimeofday(&begin, NULL);
-  minipro_status_t status;
-  size_t i, len = handle->device->write_buffer_size;
-  uint32_t address;
-  for (i = 0; i < blocks_count; i++) {
-    update_status(status_msg, "%2d%%", i * 100 / blocks_count);
-    // Translating address to protocol-specific
-    address = i * len;
-    if ((handle->device->opts4 & MP_DATA_BUS_WIDTH) && type == MP_CODE)
-      address = address >> 1;
+int read_page_ram(minipro_handle_t *handle, uint8_t *buf, uint8_t type,
+                  size_t size) {
+  return read_page_stream(handle, type, 0, size, copy_block, buf);
+}
 
-    // Last block
-    if ((i + 1) * len > size) len = size % len;
-    if (minipro_write_block(handle, type, address,
-                            buffer + i * handle->device->write_buffer_size,
-                            len))
-      return EXIT_FAILURE;
+// Write a memory range block by block. fill is called to produce every
+// block and the optional written callback after it has been written.
+int write_page_stream(minipro_handle_t *handle, uint8_t type, size_t start,
+                      size_t size, minipro_block_cb fill,
+                      minipro_block_cb written, void *ctx) {
+  char *name = type == MP_CODE ? "Code" : "Data";
+  sprintf(progress_msg, "Writing  %s...  ", name);
 
-    uint8_t ovc = 0;
-    if (minipro_get_ovc_status(handle, &status, &ovc)) return EXIT_FAILURE;
-    if (ovc) {
-      fprintf(stderr, "\nOvercurrent protection!\007\n");
-      return EXIT_FAILURE;
-    }
-    if (status.error && ! handle->cmdopts->no_verify) {
-      if (minipro_end_transaction(handle)) return EXIT_FAILURE;
-      fprintf(stderr,
-              "\nVerification failed at address 0x%04X: File=0x%02X, "
-              "Device=0x%02X\n",
-              status.address,
-              status.c2 & (WORD_SIZE(handle->device) == 1 ? 0xFF : 0xFFFF),
-              status.c1 & (WORD_SIZE(handle->device) == 1 ? 0xFF : 0xFFFF));
-      return EXIT_FAILURE;
-    }
-  }
+  struct timeval begin, end;
+  gettimeofday(&begin, NULL);
+  if (minipro_write_source(handle, type, start, size,
+                           !handle->cmdopts->no_verify, fill, written, ctx))
+    return EXIT_FAILURE;
   gettimeofday(&end, NULL);
-  sprintf(status_msg, "Writing %s...  %.2fSec  OK", name,
+  sprintf(progress_msg, "Writing %s...  %.2fSec  OK", name,
           (double)(end.tv_usec - begin.tv_usec) / 1000000 +
               (double)(end.tv_sec - begin.tv_sec));
-  update_status(status_msg, "\n");
+  update_status(progress_msg, "\n");
   return EXIT_SUCCESS;
 }
 
+static int fill_block(void *ctx, uint8_t *block, size_t offset, size_t len) {
+  memcpy(block, (uint8_t *)ctx + offset, len);
+  return EXIT_SUCCESS;
+}
+
+int write_page_ram(minipro_handle_t *handle, uint8_t *buffer, uint8_t type,
+                   size_t size) {
+  return write_page_stream(handle, type, 0, size, fill_block, NULL, buffer);
+}
+
 // Read PLD device
 int read_jedec(minipro_handle_t *handle, jedec_t *jedec) {
-  size_t i, j;
   struct timeval begin, end;
   gettimeofday(&begin, NULL);
 
-  char status_msg[64];
-  sprintf(status_msg, "Reading device... ");
-  uint8_t buffer[32];
-  gal_config_t *config = (gal_config_t *)handle->device->config;
-
-  uint8_t ovc = 0;
-  if (minipro_get_ovc_status(handle, NULL, &ovc)) return EXIT_FAILURE;
-  if (ovc) {
-    fprintf(stderr, "\nOvercurrent protection!\007\n");
-    return EXIT_FAILURE;
-  }
-
-  // Read fuses
-  memset(jedec->fuses, 0, jedec->QF);
-  for (i = 0; i < config->fuses_size; i++) {
-    if (minipro_read_jedec_row(handle, buffer, i, 0, config->row_width))
-      return EXIT_FAILURE;
-    // Unpacking the row
-    for (j = 0; j < config->row_width; j++) {
-      if (buffer[j / 8] & (0x80 >> (j & 0x07)))
-        jedec->fuses[config->fuses_size * j + i] = 1;
-    }
-    update_status(status_msg, "%2d%%", i * 100 / config->fuses_size);
-  }
-
-  // Read user electronic signature (UES)
-  // UES data can be missing in jedec, e.g. for db entry "ATF22V10C"
-  if((config->ues_address != 0) && (config->ues_size != 0)
-        && ((config->ues_address + config->ues_size) <= jedec->QF) 
-        && !(handle->device->opts1 & ATF_IN_PAL_COMPAT_MODE)) {
-    if (minipro_read_jedec_row(handle, buffer, i, 0, config->ues_size))
-     return EXIT_FAILURE;
-    for (j = 0; j < config->ues_size; j++) {
-      if (buffer[j / 8] & (0x80 >> (j & 0x07)))
-        jedec->fuses[config->ues_address + j] = 1;
-    }
-  }
-
-  // Read architecture control word (ACW)
-  if (minipro_read_jedec_row(handle, buffer, config->acw_address,
-        config->acw_address, config->acw_size))
-    return EXIT_FAILURE;
-  for (i = 0; i < config->acw_size; i++) {
-    if (buffer[i / 8] & (0x80 >> (i & 0x07)))
-      jedec->fuses[config->acw_bits[i]] = 1;
-  }
-
-  // Read Power-Down bit
-  if((config->powerdown_row != 0)
-      && (handle->device->opts1 & LAST_JEDEC_BIT_IS_POWERDOWN_ENABLE)) {
-    if (minipro_read_jedec_row(handle, buffer, config->powerdown_row, 0, 1))
-      return EXIT_FAILURE;
-    jedec->fuses[jedec->QF - 1] = (buffer[0] >> 7) & 0x01;
-  }
+  sprintf(progress_msg, "Reading device... ");
+  if (minipro_read_pld(handle, jedec)) return EXIT_FAILURE;
 
   gettimeofday(&end, NULL);
-  sprintf(status_msg, "Reading device...  %.2fSec  OK",
+  sprintf(progress_msg, "Reading device...  %.2fSec  OK",
           (double)(end.tv_usec - begin.tv_usec) / 1000000 +
               (double)(end.tv_sec - begin.tv_sec));
-  update_status(status_msg, "\n");
+  update_status(progress_msg, "\n");
   return EXIT_SUCCESS;
 }
 
 // Write PLD device
 int write_jedec(minipro_handle_t *handle, jedec_t *jedec) {
-  size_t i, j;
   struct timeval begin, end;
   gettimeofday(&begin, NULL);
 
-  char status_msg[64];
-  sprintf(status_msg, "Writing jedec file... ");
-  uint8_t buffer[32];
-  gal_config_t *config = (gal_config_t *)handle->device->config;
-
-  uint8_t ovc = 0;
-  if (minipro_get_ovc_status(handle, NULL, &ovc)) return EXIT_FAILURE;
-  if (ovc) {
-    fprintf(stderr, "\nOvercurrent protection!\007\n");
-    return EXIT_FAILURE;
-  }
-
-  // Write fuses
-  for (i = 0; i < config->fuses_size; i++) {
-    memset(buffer, 0, sizeof(buffer));
-    // Building a row
-    for (j = 0; j < config->row_width; j++) {
-      if (jedec->fuses[config->fuses_size * j + i] == 1)
-        buffer[j / 8] |= (0x80 >> (j & 0x07));
-    }
-    update_status(status_msg, "%2d%%", i * 100 / config->fuses_size);
-    if (minipro_write_jedec_row(handle, buffer, i, 0, config->row_width))
-      return EXIT_FAILURE;
-  }
-
-  // Write user electronic signature (UES)
-  memset(buffer, 0, sizeof(buffer));
-  // UES data can be missing in jedec, e.g. for db entry "ATF22V10C"
-  if((config->ues_address != 0) && (config->ues_size != 0)
-        && ((config->ues_address + config->ues_size) <= jedec->QF) 
-        && !(handle->device->opts1 & ATF_IN_PAL_COMPAT_MODE)) {
-    for (j = 0; j < config->ues_size; j++) {
-      if (jedec->fuses[config->ues_address + j] == 1)
-        buffer[j / 8] |= (0x80 >> (j & 0x07));
-    }
-  }
-  // UES field is always written, even when not contained in JEDEC
-  if (minipro_write_jedec_row(handle, buffer, i, 0, config->ues_size))
-    return EXIT_FAILURE;
-
-  // Write architecture control word (ACW)
-  memset(buffer, 0, sizeof(buffer));
-  for (i = 0; i < config->acw_size; i++) {
-    if (jedec->fuses[config->acw_bits[i]] == 1)
-      buffer[i / 8] |= (0x80 >> (i & 0x07));
-  }
-  if (minipro_write_jedec_row(handle, buffer, config->acw_address,
-                              config->acw_address, config->acw_size))
-    return EXIT_FAILURE;
-
-  // Disable Power-Down by writing to specific power-down row
-  if(config->powerdown_row != 0) {
-    // only '0' bits shall be written
-    if(((handle->device->opts1 & LAST_JEDEC_BIT_IS_POWERDOWN_ENABLE)
-              && (jedec->fuses[jedec->QF - 1] == 0))
-          || (handle->device->opts1 & POWERDOWN_MODE_DISABLE)) {
-      memset(buffer, 0, sizeof(buffer));
-      if (minipro_write_jedec_row(handle, buffer, config->powerdown_row, 0, 1))
-        return EXIT_FAILURE;
-    }
-  }
+  sprintf(progress_msg, "Writing jedec file... ");
+  if (minipro_write_pld(handle, jedec)) return EXIT_FAILURE;
 
   gettimeofday(&end, NULL);
-  sprintf(status_msg, "Writing jedec file...  %.2fSec  OK",
+  sprintf(progress_msg, "Writing jedec file...  %.2fSec  OK",
           (double)(end.tv_usec - begin.tv_usec) / 1000000 +
               (double)(end.tv_sec - begin.tv_sec));
-  update_status(status_msg, "\n");
+  update_status(progress_msg, "\n");
   return EXIT_SUCCESS;
 }
 
@@ -1258,129 +1385,6 @@ int erase_device(minipro_handle_t *handle) {
   return EXIT_SUCCESS;
 }
 
-// Opens a physical file or a pipe if the pipe character is specified
-int open_file(minipro_handle_t *handle, uint8_t *data, size_t *file_size) {
-  FILE *file;
-  struct stat st;
-
-  // Check if we are dealing with a pipe.
-  if (handle->cmdopts->is_pipe) {
-    file = stdin;
-    st.st_size = 0;
-  } else {
-    file = fopen(handle->cmdopts->filename, "rb");
-    int ret = stat(handle->cmdopts->filename, &st);
-    if (!file || ret) {
-      fprintf(stderr, "Could not open file %s for reading.\n",
-              handle->cmdopts->filename);
-      perror("");
-      if (file) fclose(file);
-      return EXIT_FAILURE;
-    }
-  }
-
-  // Allocate a zero initialized buffer.
-  // If the file size is unknown (pipe) a default size will be used.
-  uint8_t *buffer = calloc(st.st_size ? st.st_size : READ_BUFFER_SIZE, 1);
-  if (!buffer) {
-    fclose(file);
-    fprintf(stderr, "Out of memory!\n");
-    return EXIT_FAILURE;
-  }
-
-  // Try to read the whole file.
-  // If we are reading from stdin  data will be read in small chunks of 64K
-  // each untill EOF.
-  size_t br = 0;
-  size_t sz = READ_BUFFER_SIZE;
-  if (!st.st_size) {
-    size_t ch;
-    uint8_t *tmp;
-    while (br < UINT32_MAX) {
-      ch = fread(buffer + br, 1, READ_BUFFER_SIZE, file);
-      br += ch;
-      if (ch != READ_BUFFER_SIZE) break;
-      sz += READ_BUFFER_SIZE;
-      tmp = realloc(buffer, sz);
-      if (!tmp) {
-        free(buffer);
-        fclose(file);
-        fprintf(stderr, "Out of memory!\n");
-        return EXIT_FAILURE;
-      }
-      buffer = tmp;
-    }
-  } else
-    br = fread(buffer, 1, st.st_size, file);
-
-  fclose(file);
-  if(!br){
-	  fprintf(stderr, "No data to read.\n");
-	  free(buffer);
-	  return EXIT_FAILURE;
-  }
-
-  // If we are dealing with a jed file just return the data.
-  if (is_pld(handle->device->protocol_id)) {
-    memcpy(data, buffer, br);
-    free(buffer);
-    *file_size = br;
-    return EXIT_SUCCESS;
-  }
-
-  size_t chip_size = *file_size;
-  *file_size = br;
-
-  // Probe for an Intel hex file
-  size_t hex_size = chip_size;
-  int ret = read_hex_file(buffer, data, &hex_size);
-  switch (ret) {
-    case NOT_IHEX:
-      break;
-    case EXIT_FAILURE:
-      free(buffer);
-      return EXIT_FAILURE;
-      break;
-    case INTEL_HEX_FORMAT:
-      *file_size = hex_size;
-      fprintf(stderr, "Found Intel hex file.\n");
-      free(buffer);
-      return EXIT_SUCCESS;
-  }
-
-  // Probe for a Motorola srec file
-  hex_size = chip_size;
-  ret = read_srec_file(buffer, data, &hex_size);
-  switch (ret) {
-    case NOT_SREC:
-      break;
-    case EXIT_FAILURE:
-      free(buffer);
-      return EXIT_FAILURE;
-      break;
-    case SREC_FORMAT:
-      *file_size = hex_size;
-      fprintf(stderr, "Found Motorola S-Record file.\n");
-      free(buffer);
-      return EXIT_SUCCESS;
-  }
-
-  if (handle->cmdopts->format == IHEX) {
-    fprintf(stderr, "This is not an Intel hex file.\n");
-    free(buffer);
-    return EXIT_FAILURE;
-  }
-  if (handle->cmdopts->format == SREC) {
-    fprintf(stderr, "This is not an S-Record file.\n");
-    free(buffer);
-    return EXIT_FAILURE;
-  }
-  // This must be a binary file
-  memcpy(data, buffer, *file_size > chip_size ? chip_size : *file_size);
-  free(buffer);
-  return EXIT_SUCCESS;
-}
-
 // Open a JED file
 int open_jed_file(minipro_handle_t *handle, jedec_t *jedec) {
   char *buffer = calloc(READ_BUFFER_SIZE, 1);
@@ -1435,233 +1439,940 @@ FILE *get_file(minipro_handle_t *handle) {
   return file;
 }
 
-/* Wrappers for operating with files */
-int write_page_file(minipro_handle_t *handle, uint8_t type, size_t size) {
-  // Allocate the buffer and clear it with default value
-  uint8_t *file_data = malloc(size);
-  if (!file_data) {
-    fprintf(stderr, "Out of memory!\n");
-    return EXIT_FAILURE;
+/* Read checkpoints and write journals */
+typedef struct checkpoint_s {
+  FILE *file;
+  char *name;
+  const char *device;
+  uint8_t write;
+  uint8_t type;
+  size_t size;
+  size_t block_size;
+  size_t done;
+  size_t saved;
+  uint32_t crc;
+  int transform;
+} checkpoint_t;
+
+// Returns the checkpoint file name for a data file (<filename>.ckpt)
+static char *checkpoint_name(const char *filename) {
+  char *name = malloc(strlen(filename) + sizeof(CHECKPOINT_EXT));
+  if (!name) {
+    fprintf(stderr, "Out of memory\n");
+    return NULL;
   }
+  strcpy(name, filename);
+  strcat(name, CHECKPOINT_EXT);
+  return name;
+}
 
-  memset(file_data, 0xFF, size);
-  size_t file_size = size;
-  if (open_file(handle, file_data, &file_size)) return EXIT_FAILURE;
-  if (file_size != size) {
-    if (!handle->cmdopts->size_error) {
-      fprintf(stderr,
-              "Incorrect file size: %" PRI_SIZET " (needed %" PRI_SIZET ", use -s/S to ignore)\n",
-              file_size, size);
-      free(file_data);
+static void remove_checkpoint(const char *filename) {
+  char *name = checkpoint_name(filename);
+  if (!name) return;
+  remove(name);
+  free(name);
+}
+
+// Atomically replace the checkpoint file with the current progress
+static int save_checkpoint(checkpoint_t *ckpt) {
+  char tmp_name[strlen(ckpt->name) + 5];
+  sprintf(tmp_name, "%s.tmp", ckpt->name);
+
+  FILE *file = fopen(tmp_name, "w");
+  if (!file) {
+    fprintf(stderr, "\nCould not write checkpoint file %s.\n", tmp_name);
+    return EXIT_FAILURE;
+  }
+  fprintf(file,
+          "action = %s\ndevice = %s\ntype = %s\ntotal = %zu\nblock = %zu\n"
+          "done = %zu\ncrc32 = 0x%08x\n",
+          ckpt->write ? "write" : "read", ckpt->device,
+          ckpt->type == MP_CODE ? "code" : "data", ckpt->size,
+          ckpt->block_size, ckpt->done, ~ckpt->crc);
+  if (fclose(file)) {
+    fprintf(stderr, "\nCould not write checkpoint file %s.\n", tmp_name);
+    return EXIT_FAILURE;
+  }
+#ifdef _WIN32
+  remove(ckpt->name);
+#endif
+  if (rename(tmp_name, ckpt->name)) {
+    fprintf(stderr, "\nCould not write checkpoint file %s.\n", ckpt->name);
+    return EXIT_FAILURE;
+  }
+  ckpt->saved = ckpt->done;
+  return EXIT_SUCCESS;
+}
+
+// Load a checkpoint file and check it matches the current read.
+// Returns EXIT_FAILURE if the checkpoint can't be used.
+static int load_checkpoint(checkpoint_t *ckpt) {
+  char line[256], key[64], value[192];
+  char action[192] = "", device[192] = "", type[192] = "";
+  size_t size = 0, block_size = 0, done = 0;
+  uint32_t crc = 0;
+
+  FILE *file = fopen(ckpt->name, "r");
+  if (!file) return EXIT_FAILURE;
+  while (fgets(line, sizeof(line), file)) {
+    if (sscanf(line, " %63[^= ] = %191s", key, value) != 2) continue;
+    if (!strcmp(key, "action"))
+      strcpy(action, value);
+    else if (!strcmp(key, "device"))
+      strcpy(device, value);
+    else if (!strcmp(key, "type"))
+      strcpy(type, value);
+    else if (!strcmp(key, "total"))
+      size = strtoul(value, NULL, 0);
+    else if (!strcmp(key, "block"))
+      block_size = strtoul(value, NULL, 0);
+    else if (!strcmp(key, "done"))
+      done = strtoul(value, NULL, 0);
+    else if (!strcmp(key, "crc32"))
+      crc = strtoul(value, NULL, 0);
+  }
+  fclose(file);
+
+  if (strcmp(action, ckpt->write ? "write" : "read") ||
+      strcmp(device, ckpt->device) ||
+      strcmp(type, ckpt->type == MP_CODE ? "code" : "data") ||
+      size != ckpt->size || block_size != ckpt->block_size || done > size ||
+      (done % block_size && done != size)) {
+    fprintf(stderr, "Checkpoint %s does not match this %s.\n", ckpt->name,
+            ckpt->write ? "write" : "read");
+    return EXIT_FAILURE;
+  }
+  ckpt->done = done;
+  ckpt->crc = crc;
+  return EXIT_SUCCESS;
+}
+
+// Recompute the crc of the data already in the output file
+static int check_resumed_data(checkpoint_t *ckpt) {
+  uint8_t buffer[4096];
+  size_t len, remaining = ckpt->done;
+  uint32_t crc = 0xFFFFFFFF;
+
+  rewind(ckpt->file);
+  while (remaining) {
+    len = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+    if (fread(buffer, 1, len, ckpt->file) != len) {
+      fprintf(stderr, "Output file is shorter than the checkpoint.\n");
+      return EXIT_FAILURE;
+    }
+    crc = minipro_crc32(buffer, len, crc);
+    remaining -= len;
+  }
+  if (~crc != ckpt->crc) {
+    fprintf(stderr,
+            "Checksum of the data already read does not match %s.\n"
+            "Run without --resume to start over.\n",
+            ckpt->name);
+    return EXIT_FAILURE;
+  }
+  ckpt->crc = crc;
+  return EXIT_SUCCESS;
+}
+
+static int checkpoint_block(void *ctx, uint8_t *block, size_t offset,
+                            size_t len) {
+  checkpoint_t *ckpt = ctx;
+  transform_block(block, len, ckpt->transform);
+  if (fwrite(block, 1, len, ckpt->file) != len) {
+    fprintf(stderr, "\nError writing the output file.\n");
+    return EXIT_FAILURE;
+  }
+  ckpt->crc = minipro_crc32(block, len, ckpt->crc);
+  ckpt->done = offset + len;
+
+  // Flush the data to disk before recording it as done
+  if (ckpt->done - ckpt->saved >= CHECKPOINT_INTERVAL) {
+    if (fflush(ckpt->file)) return EXIT_FAILURE;
+#ifndef _WIN32
+    fsync(fileno(ckpt->file));
+#endif
+    return save_checkpoint(ckpt);
+  }
+  return EXIT_SUCCESS;
+}
+
+// Compares memory blocks against an image as they are read
+typedef struct compare_s {
+  image_t *image;
+  uint8_t *block;  // image data of the blocks being compared
+  uint16_t compare_mask;
+  int64_t address;  // first difference or -1
+  uint16_t c1, c2;
+} compare_t;
+
+static int init_compare(minipro_handle_t *handle, compare_t *cmp,
+                        image_t *image, uint8_t type, size_t block_size) {
+  cmp->image = image;
+  cmp->compare_mask = get_compare_mask(handle, type);
+  cmp->address = -1;
+  cmp->block = malloc(block_size);
+  if (!cmp->block) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// Compare the expected data of a block with the data read, through the
+// compare mask of word memories
+static void compare_data(compare_t *cmp, uint8_t *expected, uint8_t *block,
+                         size_t offset, size_t len) {
+  int idx;
+  uint8_t c1 = 0, c2 = 0;
+
+  if (cmp->compare_mask) {
+    idx = compare_word_memory(0xffff, cmp->compare_mask, 1, expected, block,
+                              len, len, &cmp->c1, &cmp->c2);
+  } else {
+    idx = compare_memory(0xff, expected, block, len, len, &c1, &c2);
+    cmp->c1 = c1;
+    cmp->c2 = c2;
+  }
+  if (idx != -1) cmp->address = offset + idx;
+}
+
+static int compare_block(void *ctx, uint8_t *block, size_t offset,
+                         size_t len) {
+  compare_t *cmp = ctx;
+
+  if (cmp->address != -1) return EXIT_SUCCESS;
+  if (read_image(cmp->image, cmp->block, offset, len)) return EXIT_FAILURE;
+  compare_data(cmp, cmp->block, block, offset, len);
+  return EXIT_SUCCESS;
+}
+
+static void print_compare_error(compare_t *cmp) {
+  if (cmp->compare_mask)
+    fprintf(stderr,
+            "Verification failed at address 0x%04X: File=0x%04X, "
+            "Device=0x%04X\n",
+            (uint32_t)cmp->address, cmp->c1, cmp->c2);
+  else
+    fprintf(stderr,
+            "Verification failed at address 0x%04X: File=0x%02X, "
+            "Device=0x%02X\n",
+            (uint32_t)cmp->address, cmp->c1, cmp->c2);
+}
+
+// Running checksums of a memory, in the forms vendors publish them
+typedef struct checksum_s {
+  uint32_t crc;    // CRC32, not inverted yet
+  uint32_t sum;    // byte sum
+  uint16_t mask;   // compare mask of word memories
+} checksum_t;
+
+static void init_checksum(checksum_t *checksum, uint16_t mask) {
+  checksum->crc = 0xFFFFFFFF;
+  checksum->sum = 0;
+  checksum->mask = mask;
+}
+
+static void update_checksum(checksum_t *checksum, uint8_t *data,
+                            size_t len) {
+  size_t i;
+
+  // Unused bits of the (little endian) words don't count
+  if (checksum->mask)
+    for (i = 0; i < len; i++)
+      data[i] &= i & 1 ? checksum->mask >> 8 : checksum->mask;
+  checksum->crc = minipro_crc32(data, len, checksum->crc);
+  for (i = 0; i < len; i++) checksum->sum += data[i];
+}
+
+// Checksums of the memory read and of the image, computed in one pass
+typedef struct checksum_verify_s {
+  image_t *image;
+  uint8_t *block;
+  checksum_t chip;
+  checksum_t file;
+} checksum_verify_t;
+
+static int checksum_block(void *ctx, uint8_t *block, size_t offset,
+                          size_t len) {
+  checksum_verify_t *verify = ctx;
+  if (read_image(verify->image, verify->block, offset, len))
+    return EXIT_FAILURE;
+  update_checksum(&verify->chip, block, len);
+  update_checksum(&verify->file, verify->block, len);
+  return EXIT_SUCCESS;
+}
+
+// Read back a memory keeping only its checksums and compare them with
+// the checksums of the image. No memory of the chip size is needed, but
+// a mismatch can't be located.
+static int verify_checksum(minipro_handle_t *handle, image_t *image,
+                           uint8_t type) {
+  checksum_verify_t verify;
+  uint16_t mask = get_compare_mask(handle, type);
+
+  verify.image = image;
+  init_checksum(&verify.chip, mask);
+  init_checksum(&verify.file, mask);
+  verify.block = malloc(handle->device->read_buffer_size);
+  if (!verify.block) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  int ret = read_page_stream(handle, type, 0, image->chip_size,
+                             checksum_block, &verify);
+  free(verify.block);
+  if (ret) return EXIT_FAILURE;
+
+  fprintf(stderr, "Device checksum: CRC32=0x%08X, Sum=0x%08X\n",
+          ~verify.chip.crc, verify.chip.sum);
+  if (verify.chip.crc != verify.file.crc ||
+      verify.chip.sum != verify.file.sum) {
+    fprintf(stderr,
+            "Verification failed: File CRC32=0x%08X, Sum=0x%08X\n",
+            ~verify.file.crc, verify.file.sum);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// Read back a memory and compare it with an image
+int verify_image(minipro_handle_t *handle, image_t *image, uint8_t type) {
+  if (handle->cmdopts->verify_mode == VERIFY_CHECKSUM &&
+      handle->cmdopts->filename)
+    return verify_checksum(handle, image, type);
+
+  size_t stride = 1;
+  if (handle->cmdopts->verify_mode == VERIFY_SAMPLE &&
+      handle->cmdopts->filename) {
+    stride = handle->cmdopts->verify_stride;
+    fprintf(stderr, "Warning: only 1 in %u blocks is read back.\n",
+            handle->cmdopts->verify_stride);
+  }
+
+  compare_t cmp;
+  if (init_compare(handle, &cmp, image, type,
+                   handle->device->read_buffer_size))
+    return EXIT_FAILURE;
+  int ret = read_page_sampled(handle, type, 0, image->chip_size, stride,
+                              compare_block, &cmp);
+  free(cmp.block);
+  if (ret) return EXIT_FAILURE;
+  if (cmp.address != -1) {
+    print_compare_error(&cmp);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+typedef struct journal_s {
+  checkpoint_t ckpt;
+  minipro_handle_t *handle;
+  image_t *image;
+  compare_t cmp;
+  uint8_t *chip_data;
+} journal_t;
+
+// Read back and compare the range written since the last journal entry
+static int verify_segment(journal_t *journal, size_t end) {
+  minipro_handle_t *handle = journal->handle;
+  size_t start = journal->ckpt.done;
+  size_t offset, len = handle->device->read_buffer_size;
+  uint32_t address;
+
+  // We must reset the transaction for VCC verify to have effect. The
+  // next segment is written in the new transaction, which sets the write
+  // voltages again, so the write protection is lifted again too.
+  if (minipro_end_transaction(handle) || minipro_begin_transaction(handle))
+    return EXIT_FAILURE;
+  if (end < journal->ckpt.size && handle->cmdopts->no_protect_off == 0 &&
+      (handle->device->opts4 & MP_PROTECT_MASK) && minipro_protect_off(handle))
+    return EXIT_FAILURE;
+
+  for (offset = start; offset < end; offset += len) {
+    address = offset;
+    if ((handle->device->opts4 & MP_DATA_BUS_WIDTH) &&
+        journal->ckpt.type == MP_CODE)
+      address = address >> 1;
+    if (minipro_read_block(handle, journal->ckpt.type, address,
+                           journal->chip_data + offset - start, len))
+      return EXIT_FAILURE;
+  }
+
+  if (compare_block(&journal->cmp, journal->chip_data, start, end - start))
+    return EXIT_FAILURE;
+  if (journal->cmp.address != -1) {
+    fprintf(stderr, "\n");
+    print_compare_error(&journal->cmp);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static int journal_fill(void *ctx, uint8_t *block, size_t offset,
+                        size_t len) {
+  return read_image(((journal_t *)ctx)->image, block, offset, len);
+}
+
+// Record every completed segment in the journal once it has been verified
+static int journal_block(void *ctx, uint8_t *block, size_t offset,
+                         size_t len) {
+  journal_t *journal = ctx;
+  size_t end = offset + len;
+  (void)block;
+
+  if (end % journal->ckpt.block_size && end != journal->ckpt.size)
+    return EXIT_SUCCESS;
+  if (!journal->handle->cmdopts->no_verify && verify_segment(journal, end))
+    return EXIT_FAILURE;
+  journal->ckpt.done = end;
+  return save_checkpoint(&journal->ckpt);
+}
+
+// Write a memory keeping a journal of the verified segments, so an
+// interrupted write can be continued with --resume without erasing.
+int write_page_journal(minipro_handle_t *handle, image_t *image, uint8_t type) {
+  size_t offset, len, size = image->chip_size;
+  journal_t journal;
+  memset(&journal, 0, sizeof(journal));
+  journal.handle = handle;
+  journal.image = image;
+  journal.ckpt.device = handle->device->name;
+  journal.ckpt.write = 1;
+  journal.ckpt.type = type;
+  journal.ckpt.size = size;
+
+  // Segments must hold a whole number of read and write blocks
+  size_t rbs = handle->device->read_buffer_size;
+  size_t wbs = handle->device->write_buffer_size;
+  size_t segment = rbs > wbs ? rbs : wbs;
+  segment *= (CHECKPOINT_INTERVAL + segment - 1) / segment;
+  if (segment % rbs || segment % wbs) segment = rbs * wbs;
+  journal.ckpt.block_size = segment;
+
+  journal.chip_data = malloc(segment + rbs);
+  if (!journal.chip_data ||
+      init_compare(handle, &journal.cmp, image, type, segment)) {
+    fprintf(stderr, "Out of memory\n");
+    free(journal.chip_data);
+    return EXIT_FAILURE;
+  }
+
+  // The image checksum identifies the image in the journal
+  journal.ckpt.crc = 0xFFFFFFFF;
+  for (offset = 0; offset < size; offset += len) {
+    len = size - offset < segment ? size - offset : segment;
+    if (read_image(image, journal.cmp.block, offset, len)) {
+      free(journal.chip_data);
+      free(journal.cmp.block);
       return EXIT_FAILURE;
-    } else if (handle->cmdopts->size_nowarn == 0)
+    }
+    journal.ckpt.crc =
+        minipro_crc32(journal.cmp.block, len, journal.ckpt.crc);
+  }
+
+  journal.ckpt.name = checkpoint_name(handle->cmdopts->filename);
+  if (!journal.ckpt.name) {
+    free(journal.chip_data);
+    free(journal.cmp.block);
+    return EXIT_FAILURE;
+  }
+
+  int ret = EXIT_SUCCESS;
+  if (handle->cmdopts->resume) {
+    if (access(journal.ckpt.name, F_OK)) {
+      fprintf(stderr, "No journal found for %s, writing from the start.\n",
+              handle->cmdopts->filename);
+    } else {
+      uint32_t crc = journal.ckpt.crc;
+      if (load_checkpoint(&journal.ckpt)) {
+        ret = EXIT_FAILURE;
+      } else if (journal.ckpt.crc != ~crc) {
+        fprintf(stderr,
+                "%s has changed since %s was written.\n"
+                "Run without --resume to start over.\n",
+                handle->cmdopts->filename, journal.ckpt.name);
+        ret = EXIT_FAILURE;
+      } else {
+        journal.ckpt.crc = crc;
+        fprintf(stderr, "Resuming %s write at 0x%zx.\n",
+                type == MP_CODE ? "Code" : "Data", journal.ckpt.done);
+      }
+    }
+  }
+  if (ret) {
+    free(journal.chip_data);
+    free(journal.cmp.block);
+    free(journal.ckpt.name);
+    return EXIT_FAILURE;
+  }
+
+  // The erased state is only trusted while nothing has been journaled.
+  // We must reset the transaction after the erase.
+  if (!journal.ckpt.done &&
+      (erase_device(handle) || minipro_end_transaction(handle) ||
+       minipro_begin_transaction(handle)))
+    ret = EXIT_FAILURE;
+
+  if (!ret && handle->cmdopts->no_protect_off == 0 &&
+      (handle->device->opts4 & MP_PROTECT_MASK)) {
+    if (minipro_protect_off(handle))
+      ret = EXIT_FAILURE;
+    else
+      fprintf(stderr, "Protect off...OK\n");
+  }
+
+  if (!ret && journal.ckpt.done < size)
+    ret = write_page_stream(handle, type, journal.ckpt.done, size,
+                            journal_fill, journal_block, &journal);
+
+  if (ret) {
+    if (journal.ckpt.done)
       fprintf(stderr,
-              "Warning: Incorrect file size: %" PRI_SIZET " (needed %" PRI_SIZET
-              ")\n",
-              file_size, size);
+              "Write interrupted, progress saved in %s.\n"
+              "Run the same command with --resume to continue.\n",
+              journal.ckpt.name);
+  } else {
+    if (!handle->cmdopts->no_verify) fprintf(stderr, "Verification OK\n");
+    remove(journal.ckpt.name);
+  }
+  free(journal.chip_data);
+  free(journal.cmp.block);
+  free(journal.ckpt.name);
+  return ret;
+}
+
+/* Wrappers for operating with files */
+static int image_block(void *ctx, uint8_t *block, size_t offset,
+                       size_t len) {
+  return read_image(ctx, block, offset, len);
+}
+
+// Open the image of a memory, or with --split the image of the whole ROM
+// set, of which only the chip's lanes are read. The set image is parsed
+// once and cached, so the next chips of the set start right away.
+static int open_chip_image(minipro_handle_t *handle, image_t *image,
+                           size_t size) {
+  if (!split) return open_image(handle, image, size);
+  if (size % split->width) {
+    fprintf(stderr, "The memory size is not a multiple of the lane width.\n");
+    return EXIT_FAILURE;
+  }
+  if (open_image(handle, image, size * split->count)) return EXIT_FAILURE;
+  image->chip_size = size;
+  image->split = split;
+  return EXIT_SUCCESS;
+}
+
+int write_page_file(minipro_handle_t *handle, uint8_t type, size_t size) {
+  image_t image;
+  patch_t patch;
+  if (open_chip_image(handle, &image, size)) return EXIT_FAILURE;
+  if (check_image_size(handle, &image)) {
+    close_image(handle, &image);
+    return EXIT_FAILURE;
+  }
+  // The serial number address is one of the set image
+  if (serial && serial->page == type) {
+    if (serial_patch(serial, &patch, image.size)) {
+      close_image(handle, &image);
+      return EXIT_FAILURE;
+    }
+    image.patch = &patch;
+  }
+
+  int ret;
+  if (handle->cmdopts->checkpoint) {
+    ret = write_page_journal(handle, &image, type);
+    close_image(handle, &image);
+    return ret;
   }
 
   // Perform an erase first
-  if (erase_device(handle)) return EXIT_FAILURE;
   // We must reset the transaction after the erase
-  if (minipro_end_transaction(handle)) return EXIT_FAILURE;
-  if (minipro_begin_transaction(handle)) return EXIT_FAILURE;
+  if (erase_device(handle) || minipro_end_transaction(handle) ||
+      minipro_begin_transaction(handle)) {
+    close_image(handle, &image);
+    return EXIT_FAILURE;
+  }
 
   if (handle->cmdopts->no_protect_off == 0 &&
       (handle->device->opts4 & MP_PROTECT_MASK)) {
     if(minipro_protect_off(handle)){
-    	free(file_data);
+    	close_image(handle, &image);
     	return EXIT_FAILURE;
     }
     fprintf(stderr, "Protect off...OK\n");
   }
 
-  if (write_page_ram(handle, file_data, type, size)) {
-    free(file_data);
+  if (write_page_stream(handle, type, 0, size, image_block, NULL, &image)) {
+    close_image(handle, &image);
     return EXIT_FAILURE;
   }
 
-  // Verify if data was written ok
-  if (handle->cmdopts->no_verify == 0) {
+  // Verify if data was written ok. The programmer already compared every
+  // block as it was written, with device verify that is all.
+  ret = EXIT_SUCCESS;
+  if (handle->cmdopts->no_verify == 0 &&
+      handle->cmdopts->verify_mode == VERIFY_DEVICE) {
+    fprintf(stderr,
+            "Warning: no readback, relying on the programmer verify only.\n");
+  } else if (handle->cmdopts->no_verify == 0) {
     // We must reset the transaction for VCC verify to have effect
-    if (minipro_end_transaction(handle)) return EXIT_FAILURE;
-    if (minipro_begin_transaction(handle)) return EXIT_FAILURE;
-
-    uint8_t *chip_data = malloc(size + 128);
-    if (!chip_data) {
-      fprintf(stderr, "Out of memory\n");
-      free(file_data);
-      return EXIT_FAILURE;
-    }
-    if (read_page_ram(handle, chip_data, type, size)) {
-      free(file_data);
-      free(chip_data);
-      return EXIT_FAILURE;
-    }
-
-    int idx;
-    uint8_t c1 = 0, c2 = 0;
-    uint16_t cw1 = 0, cw2 = 0;
-    uint16_t compare_mask = get_compare_mask(handle, type);
-    if(compare_mask) {
-      idx = compare_word_memory(0xffff, compare_mask, 1, file_data,
-      chip_data, file_size, size, &cw1, &cw2);
-    }
-    else {
-      idx = compare_memory(0xff, file_data, chip_data, file_size, size, &c1, &c2);
-    }
+    if (minipro_end_transaction(handle) || minipro_begin_transaction(handle) ||
+        verify_image(handle, &image, type))
+      ret = EXIT_FAILURE;
+    else
+      fprintf(stderr, "Verification OK\n");
+  }
 
-    free(chip_data);
+  // A ROM set takes one serial number
+  if (!ret && image.patch &&
+      (!split || (split->only < 0 && split->chip == split->count - 1)))
+    ret = advance_serial(serial);
+  close_image(handle, &image);
+  return ret;
+}
 
-    if (idx != -1) {
-      if(compare_mask) {
-        fprintf(stderr,
-            "Verification failed at address 0x%04X: File=0x%04X, Device=0x%04X\n",
-            idx, cw1, cw2);
+// Read a memory into a raw binary file, keeping a checkpoint of the
+// progress so an interrupted read can be continued with --resume.
+int read_page_checkpoint(minipro_handle_t *handle, uint8_t type, size_t size) {
+  checkpoint_t ckpt;
+  memset(&ckpt, 0, sizeof(ckpt));
+  ckpt.device = handle->device->name;
+  ckpt.type = type;
+  ckpt.size = size;
+  ckpt.block_size = handle->device->read_buffer_size;
+  ckpt.crc = 0xFFFFFFFF;
+  ckpt.transform = handle->cmdopts->transform;
+  ckpt.name = checkpoint_name(handle->cmdopts->filename);
+  if (!ckpt.name) return EXIT_FAILURE;
+
+  if (handle->cmdopts->resume) {
+    if (access(ckpt.name, F_OK)) {
+      fprintf(stderr, "No checkpoint found for %s, reading from the start.\n",
+              handle->cmdopts->filename);
+    } else {
+      if (load_checkpoint(&ckpt)) {
+        free(ckpt.name);
+        return EXIT_FAILURE;
       }
-      else {
-        fprintf(stderr,
-            "Verification failed at address 0x%04X: File=0x%02X, Device=0x%02X\n",
-            idx, c1, c2);
+      ckpt.file = fopen(handle->cmdopts->filename, "r+b");
+      if (!ckpt.file) {
+        fprintf(stderr, "Could not open file %s for resuming.\n",
+                handle->cmdopts->filename);
+        perror("");
+        free(ckpt.name);
+        return EXIT_FAILURE;
       }
+      if (check_resumed_data(&ckpt) || fseek(ckpt.file, ckpt.done, SEEK_SET)) {
+        fclose(ckpt.file);
+        free(ckpt.name);
+        return EXIT_FAILURE;
+      }
+      ckpt.saved = ckpt.done;
+      fprintf(stderr, "Resuming %s read at 0x%zx.\n",
+              type == MP_CODE ? "Code" : "Data", ckpt.done);
+    }
+  }
+
+  if (!ckpt.file) {
+    ckpt.file = fopen(handle->cmdopts->filename, "wb");
+    if (!ckpt.file) {
+      fprintf(stderr, "Could not open file %s for writing.\n",
+              handle->cmdopts->filename);
+      perror("");
+      free(ckpt.name);
       return EXIT_FAILURE;
-    } else {
-      fprintf(stderr, "Verification OK\n");
     }
   }
 
-  free(file_data);
-  return EXIT_SUCCESS;
+  int ret = EXIT_SUCCESS;
+  if (ckpt.done < size)
+    ret = read_page_stream(handle, type, ckpt.done, size, checkpoint_block,
+                           &ckpt);
+  else
+    fprintf(stderr, "%s already read, skipping.\n",
+            type == MP_CODE ? "Code" : "Data");
+
+  // Record everything that made it into the file. The checkpoint of a
+  // completed read is kept until the whole action succeeds.
+  if (fclose(ckpt.file) || save_checkpoint(&ckpt)) ret = EXIT_FAILURE;
+  if (ret)
+    fprintf(stderr,
+            "Read interrupted, progress saved in %s.\n"
+            "Run the same command with --resume to continue.\n",
+            ckpt.name);
+  free(ckpt.name);
+  return ret;
 }
 
-int read_page_file(minipro_handle_t *handle, uint8_t type, size_t size) {
-  FILE *file = get_file(handle);
-  if (!file) return EXIT_FAILURE;
+// Writes the blocks read to the output file in the selected format,
+// compressed with --compress. The encoder runs on its own thread, so
+// formatting a block overlaps the USB read of the next ones.
+typedef struct output_s {
+  FILE *file;
+  uint8_t format;
+  size_t size;
+  size_t done;
+  int transform;
+  hex_writer_t hex;
+  srec_writer_t srec;
+  cmdopts_t *cmdopts;  // --unfill
+  size_t run_start;    // run of fill bytes not known to be long enough yet
+  size_t run_len;
+  hash_t hash;         // --hash
+  pipeline_t pipeline;
+} output_t;
+
+// Hand image data to the hex or S-Record writer
+static int output_records(output_t *output, uint8_t *data, size_t offset,
+                          size_t len) {
+  if (!len) return EXIT_SUCCESS;
+  if (output->format == IHEX)
+    return hex_writer_data(&output->hex, data, offset, len);
+  return srec_writer_data(&output->srec, data, offset, len);
+}
 
-  uint8_t *buffer = malloc(size + 128);
-  if (!buffer) {
-    fprintf(stderr, "Out of memory\n");
-    fclose(file);
-    return EXIT_FAILURE;
+// Write the fill bytes of a run too short to be left out
+static int output_fill(output_t *output, size_t offset, size_t len) {
+  uint8_t fill[256];
+  memset(fill, output->cmdopts->unfill_value, sizeof(fill));
+  while (len) {
+    size_t n = len > sizeof(fill) ? sizeof(fill) : len;
+    if (output_records(output, fill, offset, n)) return EXIT_FAILURE;
+    offset += n;
+    len -= n;
   }
+  return EXIT_SUCCESS;
+}
 
-  memset(buffer, 0xFF, size);
-  if (read_page_ram(handle, buffer, type, size)) {
-    fclose(file);
-    free(buffer);
-    return EXIT_FAILURE;
+// Write the records of a block, leaving out the runs of at least
+// unfill_run fill bytes. A run may go on in the next block, so it is only
+// written once it is known to be too short.
+static int output_unfill(output_t *output, uint8_t *block, size_t offset,
+                         size_t len) {
+  uint8_t value = output->cmdopts->unfill_value;
+  size_t i, start = 0;
+
+  for (i = 0; i < len; i++) {
+    if (block[i] == value) {
+      if (!output->run_len) {
+        if (output_records(output, block + start, offset + start, i - start))
+          return EXIT_FAILURE;
+        output->run_start = offset + i;
+      }
+      output->run_len++;
+    } else if (output->run_len) {
+      if (output->run_len < output->cmdopts->unfill_run &&
+          output_fill(output, output->run_start, output->run_len))
+        return EXIT_FAILURE;
+      output->run_len = 0;
+      start = i;
+    }
   }
+  if (output->run_len) return EXIT_SUCCESS;
+  return output_records(output, block + start, offset + start, len - start);
+}
 
-  switch (handle->cmdopts->format) {
+static int output_block(output_t *output, uint8_t *block, size_t offset,
+                        size_t len) {
+  transform_block(block, len, output->transform);
+  if (output->hash.methods) hash_update(&output->hash, block, len);
+  output->done = offset + len;
+  switch (output->format) {
     case IHEX:
-      if (write_hex_file(file, buffer, size)) {
-        fclose(file);
-        return EXIT_FAILURE;
-      }
-      break;
     case SREC:
-      if (write_srec_file(file, buffer, size)) {
-        fclose(file);
+      if (output->cmdopts->unfill)
+        return output_unfill(output, block, offset, len);
+      return output_records(output, block, offset, len);
+    default:
+      if (fwrite(block, 1, len, output->file) != len) {
+        fprintf(stderr, "\nError writing the output file.\n");
         return EXIT_FAILURE;
       }
-      break;
-    default:
-      fwrite(buffer, 1, size, file);
   }
+  return EXIT_SUCCESS;
+}
 
-  fclose(file);
-  free(buffer);
+// Finish a complete hex or S-Record file
+static int output_end(output_t *output) {
+  if (output->run_len && output->run_len < output->cmdopts->unfill_run &&
+      output_fill(output, output->run_start, output->run_len))
+    return EXIT_FAILURE;
+  if (output->format == IHEX) return hex_writer_end(&output->hex);
+  if (output->format == SREC) return srec_writer_end(&output->srec);
   return EXIT_SUCCESS;
 }
 
-int verify_page_file(minipro_handle_t *handle, uint8_t type, size_t size) {
-  uint8_t *file_data;
+// Encoder stage
+static int output_stage(void *ctx) {
+  output_t *output = ctx;
+  pipeline_slot_t *slot;
 
-  char *name = type == MP_CODE ? "Code" : "Data";
-  size_t file_size = size;
-  if (handle->cmdopts->filename) {
-    // Allocate the buffer and clear it with default value
-    file_data = malloc(size);
-    if (!file_data) {
-      fprintf(stderr, "Out of memory!\n");
+  while ((slot = pipeline_peek(&output->pipeline))) {
+    if (output_block(output, slot->data, slot->offset, slot->len))
       return EXIT_FAILURE;
-    }
-
-    memset(file_data, 0xFF, size);
-    if (open_file(handle, file_data, &file_size)) return EXIT_FAILURE;
+    pipeline_release(&output->pipeline);
+  }
+  if (output->done == output->size) return output_end(output);
+  return EXIT_SUCCESS;
+}
 
-    if (file_size != size) {
-      if (!handle->cmdopts->size_error) {
-        fprintf(stderr,
-                "Incorrect file size: %" PRI_SIZET " (needed %" PRI_SIZET ", use -s/S to ignore)\n",
-                file_size, size);
-        free(file_data);
-        return EXIT_FAILURE;
-      } else if (handle->cmdopts->size_nowarn == 0)
-        fprintf(stderr,
-                "Warning: Incorrect file size: %" PRI_SIZET
-                " (needed %" PRI_SIZET ")\n",
-                file_size, size);
-    }
+// Data bytes per record of the file read: --obs, or what fits in
+// --line_length, 16 by default
+static size_t output_row_size(cmdopts_t *cmdopts, size_t size) {
+  size_t row = 16, max, overhead;
+  uint64_t end = cmdopts->offset + size;
 
+  if (cmdopts->format == IHEX) {
+    max = IHEX_MAX_ROW;
+    overhead = 11;  // ':', count, address, type and checksum
+  } else {
+    max = SREC_MAX_ROW;
+    overhead = end <= 0x10000 ? 10 : end <= 0x1000000 ? 12 : 14;
   }
-  // Blank check
-  else {
-    file_data = malloc(size);
-    memset(file_data, 0xFF, size);
+  if (cmdopts->row_size) row = cmdopts->row_size;
+  if (cmdopts->line_length) {
+    size_t fit = cmdopts->line_length > overhead
+                     ? (cmdopts->line_length - overhead) / 2
+                     : 0;
+    if (!cmdopts->row_size || fit < row) row = fit;
   }
+  return row > max ? max : row;
+}
 
-  /* Downloading data from chip*/
-  uint8_t *chip_data = malloc(size + 128);
-  if (!chip_data) {
+// Reader stage, called for every block read
+static int queue_block(void *ctx, uint8_t *block, size_t offset, size_t len) {
+  output_t *output = ctx;
+  pipeline_slot_t *slot = pipeline_acquire(&output->pipeline);
+
+  // The encoder failed
+  if (!slot) return EXIT_FAILURE;
+  memcpy(slot->data, block, len);
+  slot->offset = offset;
+  slot->len = len;
+  pipeline_publish(&output->pipeline);
+  return EXIT_SUCCESS;
+}
+
+// Print the hashes of a memory read and save them next to the file
+static int save_hashes(minipro_handle_t *handle, hash_t *hash) {
+  if (handle->cmdopts->is_pipe) return hash_print(hash, stderr, "-");
+
+  // Named as in the directory of the file, so the file can be checked
+  // wherever the two are archived
+  char *name = strrchr(handle->cmdopts->filename, '/');
+  name = name ? name + 1 : handle->cmdopts->filename;
+  hash_print(hash, stderr, name);
+
+  char *path = malloc(strlen(handle->cmdopts->filename) + sizeof(".hash"));
+  if (!path) {
+    fprintf(stderr, "Out of memory!\n");
+    return EXIT_FAILURE;
+  }
+  sprintf(path, "%s.hash", handle->cmdopts->filename);
+  FILE *file = fopen(path, "w");
+  int ret = file ? hash_print(hash, file, name) : EXIT_FAILURE;
+  if (file && fclose(file)) ret = EXIT_FAILURE;
+  if (ret) fprintf(stderr, "Could not write the hash file %s.\n", path);
+  free(path);
+  return ret;
+}
+
+int read_page_file(minipro_handle_t *handle, uint8_t type, size_t size) {
+  if (handle->cmdopts->checkpoint && handle->cmdopts->compress) {
+    fprintf(stderr, "--compress can't be used with --checkpoint.\n");
+    return EXIT_FAILURE;
+  }
+  if (handle->cmdopts->checkpoint)
+    return read_page_checkpoint(handle, type, size);
+
+  output_t output;
+  memset(&output, 0, sizeof(output));
+  output.format = handle->cmdopts->format;
+  output.size = size;
+  output.transform = handle->cmdopts->transform;
+  output.cmdopts = handle->cmdopts;
+  // Hashed on the encoder thread, as the blocks arrive
+  hash_init(&output.hash, handle->cmdopts->hash);
+  size_t row_size = output_row_size(handle->cmdopts, size);
+  if (output.format && !row_size) {
+    fprintf(stderr, "The line length is too short for a record.\n");
+    return EXIT_FAILURE;
+  }
+  if (pipeline_init(&output.pipeline, PIPELINE_DEPTH,
+                    handle->device->read_buffer_size)) {
     fprintf(stderr, "Out of memory\n");
-    free(file_data);
     return EXIT_FAILURE;
   }
-  if (read_page_ram(handle, chip_data, type, size)) {
-    free(file_data);
-    free(chip_data);
+  output.file = get_file(handle);
+  if (output.file && handle->cmdopts->compress) {
+    // Compressed on the encoder thread along with the formatting
+    FILE *file = compress_fopen(output.file, handle->cmdopts->compress);
+    if (!file) fclose(output.file);
+    output.file = file;
+  }
+  if (!output.file) {
+    pipeline_free(&output.pipeline);
+    return EXIT_FAILURE;
+  }
+  if (output.format == IHEX)
+    hex_writer_init(&output.hex, output.file, handle->cmdopts->offset,
+                    row_size, size);
+  else if (output.format == SREC)
+    srec_writer_init(&output.srec, output.file, handle->cmdopts->offset,
+                     row_size);
+  if (pipeline_start(&output.pipeline, output_stage, &output)) {
+    fprintf(stderr, "Could not start the output thread.\n");
+    fclose(output.file);
+    pipeline_free(&output.pipeline);
     return EXIT_FAILURE;
   }
 
-  int idx;
-  uint8_t c1 = 0, c2 = 0;
-  uint16_t cw1 = 0, cw2 = 0;
-  uint16_t compare_mask = get_compare_mask(handle, type);
-  if(compare_mask) {
-    idx = compare_word_memory(0xffff, compare_mask, 1, file_data,
-    chip_data, file_size, size, &cw1, &cw2);
+  int ret = read_page_stream(handle, type, 0, size, queue_block, &output);
+  if (ret)
+    pipeline_abort(&output.pipeline);
+  else
+    pipeline_close(&output.pipeline);
+  if (pipeline_join(&output.pipeline)) ret = EXIT_FAILURE;
+  pipeline_free(&output.pipeline);
+
+  if (fclose(output.file) && !ret) {
+    fprintf(stderr, "Error writing the output file.\n");
+    ret = EXIT_FAILURE;
   }
-  else {
-    idx = compare_memory(0xff, file_data, chip_data, file_size, size, &c1, &c2);
+  if (!ret && output.hash.methods) {
+    hash_final(&output.hash);
+    ret = save_hashes(handle, &output.hash);
   }
+  return ret;
+}
 
-  free(file_data);
-  free(chip_data);
+int verify_page_file(minipro_handle_t *handle, uint8_t type, size_t size) {
+  image_t image;
+  char *name = type == MP_CODE ? "Code" : "Data";
 
-  if (idx != -1) {
-    if(compare_mask) {
-      fprintf(stderr,
-          "Verification failed at address 0x%04X: File=0x%04X, Device=0x%04X\n",
-          idx, cw1, cw2);
-    }
-    else {
-      fprintf(stderr,
-          "Verification failed at address 0x%04X: File=0x%02X, Device=0x%02X\n",
-          idx, c1, c2);
-    }
+  // Without a file name this is a blank check
+  if (open_chip_image(handle, &image, size)) return EXIT_FAILURE;
+  if (check_image_size(handle, &image)) {
+    close_image(handle, &image);
     return EXIT_FAILURE;
+  }
+
+  int ret = verify_image(handle, &image, type);
+  close_image(handle, &image);
+  if (ret) return EXIT_FAILURE;
+  if (handle->cmdopts->filename) {
+    fprintf(stderr, "Verification OK\n");
   } else {
-    if (handle->cmdopts->filename) {
-      fprintf(stderr, "Verification OK\n");
-    } else {
-      fprintf(stderr, "%s memory section is blank.\n", name);
-    }
+    fprintf(stderr, "%s memory section is blank.\n", name);
   }
   return EXIT_SUCCESS;
 }
 
-int read_fuses(minipro_handle_t *handle, fuse_decl_t *fuses) {
+int read_fuses(minipro_handle_t *handle, const fuse_decl_t *decl) {
+  // The declaration tables are shared, so work on a copy
+  fuse_decl_t copy = *decl, *fuses = &copy;
   size_t i;
   char config[1024];
   uint8_t buffer[64];
@@ -1747,7 +2458,9 @@ int read_fuses(minipro_handle_t *handle, fuse_decl_t *fuses) {
   return EXIT_SUCCESS;
 }
 
-int write_fuses(minipro_handle_t *handle, fuse_decl_t *fuses) {
+int write_fuses(minipro_handle_t *handle, const fuse_decl_t *decl) {
+  // The declaration tables are shared, so work on a copy
+  fuse_decl_t copy = *decl, *fuses = &copy;
   size_t i;
   uint8_t wbuffer[64], vbuffer[64];
   char config[1024];
@@ -1761,6 +2474,7 @@ int write_fuses(minipro_handle_t *handle, fuse_decl_t *fuses) {
   fprintf(stderr, "Writing fuses... ");
   fflush(stderr);
 
+  fuses->num_locks &= 0x7f;
   // Atmel microcontrollers workaround
   uint8_t items;
   if (!fuses->word) {
@@ -1884,6 +2598,10 @@ int action_read(minipro_handle_t *handle) {
 
   if (minipro_begin_transaction(handle)) return EXIT_FAILURE;
   if (is_pld(handle->device->protocol_id)) {
+    if (handle->cmdopts->checkpoint) {
+      fprintf(stderr, "Checkpointed reads are not supported for PLDs.\n");
+      return EXIT_FAILURE;
+    }
     jedec.QF = handle->device->code_memory_size;
     if (!jedec.QF) {
       fprintf(stderr, "Unknown fuse size!\n");
@@ -1919,14 +2637,16 @@ int action_read(minipro_handle_t *handle) {
       data_filename = default_data_filename;
       config_filename = default_config_filename;
     }
+    char *code_filename = NULL, *data_read = NULL;
     if (handle->cmdopts->page == CODE || handle->cmdopts->page == UNSPECIFIED) {
+      code_filename = handle->cmdopts->filename;
       if (read_page_file(handle, MP_CODE, handle->device->code_memory_size))
         return EXIT_FAILURE;
     }
     if ((handle->cmdopts->page == DATA ||
          (handle->cmdopts->page == UNSPECIFIED && !handle->cmdopts->is_pipe)) &&
         handle->device->data_memory_size) {
-      handle->cmdopts->filename = data_filename;
+      handle->cmdopts->filename = data_read = data_filename;
       if (read_page_file(handle, MP_DATA, handle->device->data_memory_size))
         return EXIT_FAILURE;
     }
@@ -1937,6 +2657,12 @@ int action_read(minipro_handle_t *handle) {
       if (read_fuses(handle, handle->device->config)) return EXIT_FAILURE;
     }
 
+    // All pages are read, the checkpoints are no longer needed
+    if (handle->cmdopts->checkpoint) {
+      if (code_filename) remove_checkpoint(code_filename);
+      if (data_read) remove_checkpoint(data_read);
+    }
+
     if (handle->cmdopts->page == DATA && !handle->device->data_memory_size) {
       fprintf(stderr, "No data section found.\n");
       return EXIT_FAILURE;
@@ -1957,6 +2683,10 @@ int action_write(minipro_handle_t *handle) {
   uint8_t c1, c2;
 
   if (is_pld(handle->device->protocol_id)) {
+    if (handle->cmdopts->checkpoint) {
+      fprintf(stderr, "Journaled writes are not supported for PLDs.\n");
+      return EXIT_FAILURE;
+    }
     if (open_jed_file(handle, &wjedec)) return EXIT_FAILURE;
 
     if (handle->cmdopts->no_protect_on == 0)
@@ -2196,7 +2926,8 @@ int action_verify(minipro_handle_t *handle) {
 
       if (minipro_begin_transaction(handle)) return EXIT_FAILURE;
 
-      fuse_decl_t *fuses = ((fuse_decl_t *)handle->device->config);
+      const fuse_decl_t *decl = (const fuse_decl_t *)handle->device->config;
+      fuse_decl_t copy = *decl, *fuses = &copy;
       // Atmel microcontrollers workaround
       uint8_t items;
       if (!fuses->word) {
@@ -2279,6 +3010,365 @@ int action_verify(minipro_handle_t *handle) {
   return ret;
   }
 
+// Sort helper for the latency samples
+static int compare_samples(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Print the statistics gathered for one memory type
+static void bench_report(bench_t *stats, uint32_t passes) {
+  if (!stats->count) return;
+  qsort(stats->samples, stats->count, sizeof(uint32_t), compare_samples);
+  size_t p99 = (stats->count * 99 + 99) / 100 - 1;
+  fprintf(stderr,
+          "%s: %u passes, %" PRI_SIZET " blocks, %llu bytes\n"
+          "  Block latency: min %.3fms  median %.3fms  p99 %.3fms\n"
+          "  Throughput: %.2f KB/s\n",
+          stats->name, passes, stats->count,
+          (unsigned long long)stats->bytes, stats->samples[0] / 1000.0,
+          stats->samples[stats->count / 2] / 1000.0,
+          stats->samples[p99] / 1000.0,
+          stats->usec ? stats->bytes * 1000000.0 / stats->usec / 1024 : 0);
+}
+
+// Run the benchmark passes on a code or data memory
+static int benchmark_page(minipro_handle_t *handle, uint8_t type, size_t size) {
+  uint32_t pass, passes = handle->cmdopts->bench_passes;
+  uint8_t *pattern = NULL;
+  uint64_t begin;
+  int ret = EXIT_FAILURE;
+
+  bench_t rstats, wstats;
+  memset(&rstats, 0, sizeof(rstats));
+  memset(&wstats, 0, sizeof(wstats));
+  rstats.name = type == MP_CODE ? "Code read" : "Data read";
+  wstats.name = type == MP_CODE ? "Code write" : "Data write";
+
+  uint8_t *chip_data = malloc(size + 128);
+  if (handle->cmdopts->bench_write) pattern = malloc(size);
+  if (!chip_data || (handle->cmdopts->bench_write && !pattern)) {
+    fprintf(stderr, "Out of memory\n");
+    goto cleanup;
+  }
+
+  if (minipro_begin_transaction(handle)) goto cleanup;
+  if (handle->cmdopts->bench_write && handle->cmdopts->no_protect_off == 0 &&
+      (handle->device->opts4 & MP_PROTECT_MASK)) {
+    if (minipro_protect_off(handle)) goto cleanup;
+    fprintf(stderr, "Protect off...OK\n");
+  }
+
+  for (pass = 0; pass < passes; pass++) {
+    if (handle->cmdopts->bench_write) {
+      // A different pseudo-random pattern on every pass (xorshift32)
+      uint32_t i, x = 0x9E3779B9 * (pass + 1);
+      for (i = 0; i < size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        pattern[i] = (uint8_t)x;
+      }
+
+      if (erase_device(handle)) goto cleanup;
+      if (minipro_end_transaction(handle)) goto cleanup;
+      if (minipro_begin_transaction(handle)) goto cleanup;
+
+      bench = &wstats;
+      begin = get_usec();
+      ret = write_page_ram(handle, pattern, type, size);
+      wstats.usec += get_usec() - begin;
+      bench = NULL;
+      if (ret) goto cleanup;
+      ret = EXIT_FAILURE;
+
+      // We must reset the transaction for VCC verify to have effect
+      if (minipro_end_transaction(handle)) goto cleanup;
+      if (minipro_begin_transaction(handle)) goto cleanup;
+    }
+
+    bench = &rstats;
+    begin = get_usec();
+    ret = read_page_ram(handle, chip_data, type, size);
+    rstats.usec += get_usec() - begin;
+    bench = NULL;
+    if (ret) goto cleanup;
+    ret = EXIT_FAILURE;
+
+    if (handle->cmdopts->bench_write) {
+      compare_t cmp;
+      cmp.compare_mask = get_compare_mask(handle, type);
+      cmp.address = -1;
+      compare_data(&cmp, pattern, chip_data, 0, size);
+      if (cmp.address != -1) {
+        print_compare_error(&cmp);
+        goto cleanup;
+      }
+    }
+  }
+  ret = EXIT_SUCCESS;
+
+  bench_report(&rstats, passes);
+  bench_report(&wstats, passes);
+
+cleanup:
+  free(rstats.samples);
+  free(wstats.samples);
+  free(chip_data);
+  free(pattern);
+  return ret;
+}
+
+// Repeated reads (and optionally write/verify cycles) to qualify a setup
+int action_benchmark(minipro_handle_t *handle) {
+  uint32_t pass, passes = handle->cmdopts->bench_passes;
+  uint64_t begin;
+  int ret;
+
+  if (handle->cmdopts->bench_write)
+    fprintf(stderr, "WARNING: the chip contents will be destroyed!\n");
+
+  if (is_pld(handle->device->protocol_id)) {
+    jedec_t jedec;
+    bench_t stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "JEDEC rows read";
+
+    if (handle->cmdopts->bench_write)
+      fprintf(stderr, "Write cycles are not supported for PLD devices.\n");
+
+    jedec.QF = handle->device->code_memory_size;
+    if (!jedec.QF) {
+      fprintf(stderr, "Unknown fuse size!\n");
+      return EXIT_FAILURE;
+    }
+    jedec.fuses = malloc(jedec.QF);
+    if (!jedec.fuses) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+
+    ret = minipro_begin_transaction(handle);
+    for (pass = 0; pass < passes && !ret; pass++) {
+      bench = &stats;
+      begin = get_usec();
+      ret = read_jedec(handle, &jedec);
+      stats.usec += get_usec() - begin;
+      bench = NULL;
+    }
+    if (!ret) bench_report(&stats, passes);
+    free(stats.samples);
+    free(jedec.fuses);
+    return ret;
+  }
+
+  if (benchmark_page(handle, MP_CODE, handle->device->code_memory_size))
+    return EXIT_FAILURE;
+  if (handle->device->data_memory_size &&
+      benchmark_page(handle, MP_DATA, handle->device->data_memory_size))
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
+
+// Verify the chip ID (if applicable). Returns EXIT_FAILURE on a mismatch
+// unless -y was given.
+int check_chip_id(minipro_handle_t *handle) {
+  uint8_t id_type;
+  if (handle->cmdopts->idcheck_skip) {
+    fprintf(stderr, "WARNING: skipping Chip ID test\n");
+  } else if ((handle->device->chip_id_bytes_count &&
+              handle->device->chip_id) &&
+             (handle->device->opts4 & MP_ID_MASK)) {
+    if (minipro_begin_transaction(handle)) return EXIT_FAILURE;
+    uint32_t chip_id;
+    if (minipro_get_chip_id(handle, &id_type, &chip_id)) return EXIT_FAILURE;
+    if (minipro_end_transaction(handle)) return EXIT_FAILURE;
+    uint32_t chip_id_temp = chip_id;
+    uint8_t shift = 0;
+    /* The id_type will tell us the Chip ID type. There are 5 types */
+    uint32_t ok = 0;
+    switch (id_type) {
+      case MP_ID_TYPE1:  // 1-3 bytes ID
+      case MP_ID_TYPE2:  // 4 bytes ID
+      case MP_ID_TYPE5:  // 3 bytes ID, this ID type is returning from 25 SPI
+                         // series.
+        ok = (chip_id == handle->device->chip_id);
+        if (ok) {
+          fprintf(stderr, "Chip ID OK: 0x%04X\n", chip_id);
+        }
+        break;
+      case MP_ID_TYPE3:  // Microchip controllers with 5 bit revision number.
+        ok = (handle->device->chip_id >> 5 ==
+              (chip_id >> 5));  // Throw the chip revision (last 5 bits).
+        if (ok) {
+          fprintf(stderr, "Chip ID OK: 0x%04X Rev.0x%02X\n", chip_id >> 5,
+                  chip_id & 0x1F);
+        }
+        chip_id >>= 5;
+        chip_id_temp = chip_id << 5;
+        shift = 5;
+        break;
+      case MP_ID_TYPE4:  // Microchip controllers with 4-5 bit revision
+                         // number.
+        ok = (handle->device->chip_id >>
+                  ((fuse_decl_t *)handle->device->config)->rev_mask ==
+              (chip_id >> ((fuse_decl_t *)handle->device->config)
+                              ->rev_mask));  // Throw the chip revision (last
+                                             // rev_mask bits).
+        if (ok) {
+          fprintf(
+              stderr, "Chip ID OK: 0x%04X Rev.0x%02X\n",
+              chip_id >> ((fuse_decl_t *)handle->device->config)->rev_mask,
+              chip_id & ~(0xFF << ((fuse_decl_t *)handle->device->config)
+                                      ->rev_mask));
+        }
+        chip_id >>= ((fuse_decl_t *)handle->device->config)->rev_mask;
+        chip_id_temp = chip_id
+                       << ((fuse_decl_t *)handle->device->config)->rev_mask;
+        shift = ((fuse_decl_t *)handle->device->config)->rev_mask;
+        break;
+    }
+
+    if (!ok) {
+      const char *name = get_device_from_id(handle->version, chip_id_temp,
+                                            handle->device->protocol_id);
+      if (handle->cmdopts->idcheck_only) {
+        fprintf(stderr,
+                "Chip ID mismatch: expected 0x%04X, got 0x%04X (%s)\n",
+                handle->device->chip_id >> shift, chip_id_temp >> shift,
+                name ? name : "unknown");
+        if(name) free((char*)name);
+        return EXIT_FAILURE;
+      }
+      if (handle->cmdopts->idcheck_continue) {
+        fprintf(
+            stderr,
+            "WARNING: Chip ID mismatch: expected 0x%04X, got 0x%04X (%s)\n",
+            handle->device->chip_id >> shift, chip_id_temp >> shift,
+            name ? name : "unknown");
+      } else {
+        fprintf(
+            stderr,
+            "Invalid Chip ID: expected 0x%04X, got 0x%04X (%s)\n(use '-y' "
+            "to continue anyway at your own risk)\n",
+            handle->device->chip_id >> shift, chip_id_temp,
+            name ? name : "unknown");
+        if(name) free((char*)name);
+        return EXIT_FAILURE;
+      }
+      if(name) free((char*)name);
+    }
+  } else if (handle->cmdopts->idcheck_only) {
+    fprintf(stderr, "This chip doesn't have a chip id!\n");
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Perform the action selected in cmdopts
+int run_action(minipro_handle_t *handle) {
+  switch (handle->cmdopts->action) {
+    case READ:
+      return action_read(handle);
+    case WRITE:
+      return action_write(handle);
+    case VERIFY:
+    case BLANK_CHECK:
+      return action_verify(handle);
+    case BENCHMARK:
+      return action_benchmark(handle);
+    case ERASE:
+      if (!(handle->device->opts4 & MP_ERASE_MASK)) {
+        fprintf(stderr, "This chip can't be erased!\n");
+        return EXIT_FAILURE;
+      }
+      if (minipro_begin_transaction(handle)) return EXIT_FAILURE;
+      return erase_device(handle);
+    default:
+      return EXIT_FAILURE;
+  }
+}
+
+/* Device selection */
+
+// Command line used for the -o options of every selected device
+static int saved_argc;
+static char **saved_argv;
+
+int apply_options(minipro_handle_t *handle) {
+  return parse_options(handle, saved_argc, saved_argv);
+}
+
+// Unlock the adapter and set up ICSP for the current device
+int prepare_device(minipro_handle_t *handle) {
+  // Check for GAL/PLD
+  if (!is_pld(handle->device->protocol_id) &&
+      (!handle->device->read_buffer_size || !handle->device->protocol_id)) {
+    fprintf(stderr, "Unsupported device!\n");
+    return EXIT_FAILURE;
+  }
+
+  // Unlocking the TSOP48 adapter (if applicable)
+  uint8_t status;
+  switch (handle->device->package_details & ADAPTER_MASK) {
+    case TSOP48_ADAPTER:
+    case SOP44_ADAPTER:
+    case SOP56_ADAPTER:
+      if (minipro_unlock_tsop48(handle, &status)) return EXIT_FAILURE;
+      switch (status) {
+        case MP_TSOP48_TYPE_V3:
+          fprintf(stderr, "Found TSOP adapter V3\n");
+          break;
+        case MP_TSOP48_TYPE_NONE:
+          minipro_end_transaction(handle);  // We need this to turn off the
+                                            // power on the ZIF socket.
+          fprintf(stderr, "TSOP adapter not found!\n");
+          return EXIT_FAILURE;
+        case MP_TSOP48_TYPE_V0:
+          fprintf(stderr, "Found TSOP adapter V0\n");
+          break;
+        case MP_TSOP48_TYPE_FAKE1:
+        case MP_TSOP48_TYPE_FAKE2:
+          fprintf(stderr, "Fake TSOP adapter found!\n");
+          break;
+      }
+      minipro_end_transaction(handle);
+      break;
+  }
+
+  // Activate ICSP if the chip can only be programmed via ICSP.
+  handle->icsp = 0;
+  if ((handle->device->package_details & ICSP_MASK) &&
+      ((handle->device->package_details & PIN_COUNT_MASK) == 0)) {
+    handle->icsp = MP_ICSP_ENABLE | MP_ICSP_VCC;
+  } else if (handle->device->package_details & ICSP_MASK)
+    handle->icsp = handle->cmdopts->icsp;
+  if (handle->icsp) fprintf(stderr, "Activating ICSP...\n");
+  return EXIT_SUCCESS;
+}
+
+// Switch the handle to another device and check the inserted chip
+int select_device(minipro_handle_t *handle, const char *name) {
+  device_t *device = get_device_by_name(handle->version, name);
+  if (!device) {
+    fprintf(stderr, "Device %s not found!\n", name);
+    return EXIT_FAILURE;
+  }
+  // The name may belong to the current device, so replace it only now
+  if (handle->device) free(handle->device);
+  handle->device = device;
+  handle->cmdopts->device = device->name;
+
+  if (apply_options(handle)) {
+    fprintf(stderr, "Invalid programming options for %s.\n", device->name);
+    return EXIT_FAILURE;
+  }
+  if (prepare_device(handle) || check_chip_id(handle)) return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
+
   int main(int argc, char **argv) {
 #ifdef _WIN32
     system(" ");  // If we are in windows start the VT100 support
@@ -2301,16 +3391,137 @@ int action_verify(minipro_handle_t *handle) {
         break;
     }
 
+    job_t job;
+    memset(&job, 0, sizeof(job));
+    if (cmdopts.job || cmdopts.daemon) {
+      if (cmdopts.action != NO_ACTION || cmdopts.idcheck_only ||
+          cmdopts.checkpoint || cmdopts.idcheck_skip || cmdopts.pincheck ||
+          (cmdopts.job && cmdopts.daemon)) {
+        fprintf(stderr,
+                "--job and --daemon can't be combined with each other, other "
+                "actions, --checkpoint, --resume, -x or -z.\n");
+        print_help_and_exit(argv[0]);
+      }
+#ifdef _WIN32
+      if (cmdopts.daemon) {
+        fprintf(stderr, "--daemon is not supported on this platform.\n");
+        return EXIT_FAILURE;
+      }
+#endif
+    }
+#ifdef _WIN32
+    if (cmdopts.image_cache) {
+      fprintf(stderr, "--image_cache is not supported on this platform.\n");
+      return EXIT_FAILURE;
+    }
+#endif
+    if (cmdopts.loop &&
+        (cmdopts.daemon || cmdopts.action == READ ||
+         cmdopts.action == BENCHMARK || cmdopts.idcheck_only ||
+         cmdopts.checkpoint || cmdopts.pincheck)) {
+      fprintf(stderr,
+              "--loop can only be used with -w, -m, -b, -E or --job.\n");
+      print_help_and_exit(argv[0]);
+    }
+    if (cmdopts.job) {
+      if (parse_job(cmdopts.job, &job)) return EXIT_FAILURE;
+      // A leading device step stands for -p
+      if (!cmdopts.device && job.steps[0].action == JOB_DEVICE) {
+        cmdopts.device = job.steps[0].arg;
+        free(job.steps[0].text);
+        job.count--;
+        memmove(job.steps, job.steps + 1, job.count * sizeof(job_step_t));
+      }
+    }
+
     // Check if a device name is required
-    if (!cmdopts.device) {
+    if (!cmdopts.device && !cmdopts.daemon) {
       fprintf(stderr,
               "Device required. Use -p <device> to specify a device.\n");
       print_help_and_exit(argv[0]);
     }
 
+    if (cmdopts.serial) {
+      if ((cmdopts.action != WRITE && !cmdopts.job && !cmdopts.daemon) ||
+          cmdopts.checkpoint) {
+        fprintf(stderr,
+                "--serial requires -w or --job, without --checkpoint.\n");
+        print_help_and_exit(argv[0]);
+      }
+      serial = parse_serial(cmdopts.serial);
+      if (!serial) return EXIT_FAILURE;
+    }
+
+    if (cmdopts.split) {
+      if ((cmdopts.action != WRITE && cmdopts.action != VERIFY) ||
+          cmdopts.checkpoint || !cmdopts.filename ||
+          !strcmp(cmdopts.filename, "-")) {
+        fprintf(stderr,
+                "--split requires -w or -m with an image file, without "
+                "--checkpoint.\n");
+        print_help_and_exit(argv[0]);
+      }
+      split = parse_split(cmdopts.split);
+      if (!split) return EXIT_FAILURE;
+    }
+
+    if ((cmdopts.unfill || cmdopts.row_size || cmdopts.line_length) &&
+        (cmdopts.action != READ || !cmdopts.format)) {
+      fprintf(stderr,
+              "--unfill, --obs and --line_length require reading to an "
+              "Intel hex or S-Record file (-r with -f).\n");
+      print_help_and_exit(argv[0]);
+    }
+
+    if (cmdopts.offset && cmdopts.action == READ &&
+        (!cmdopts.format || cmdopts.offset < 0)) {
+      fprintf(stderr,
+              "--offset requires a non-negative offset and -f when "
+              "reading.\n");
+      print_help_and_exit(argv[0]);
+    }
+
+    if ((cmdopts.action == WRITE || cmdopts.action == VERIFY) &&
+        cmdopts.filename && is_composed_image(cmdopts.filename) &&
+        (cmdopts.checkpoint || cmdopts.offset)) {
+      fprintf(stderr,
+              "An image composed of several files can't be used with "
+              "--checkpoint or --offset.\n");
+      print_help_and_exit(argv[0]);
+    }
+
+    if (cmdopts.hash && (cmdopts.action != READ || cmdopts.checkpoint)) {
+      fprintf(stderr, "--hash requires -r, without --checkpoint.\n");
+      print_help_and_exit(argv[0]);
+    }
+
+    if (cmdopts.bench_write && cmdopts.action != BENCHMARK) {
+      fprintf(stderr, "--benchmark_write requires --benchmark.\n");
+      print_help_and_exit(argv[0]);
+    }
+
+    if (cmdopts.checkpoint &&
+        ((cmdopts.action != READ && cmdopts.action != WRITE) ||
+         !strcmp(cmdopts.filename, "-") ||
+         (cmdopts.action == READ && cmdopts.format))) {
+      fprintf(stderr,
+              "--checkpoint and --resume require reading to a binary file "
+              "or writing from a file.\n");
+      print_help_and_exit(argv[0]);
+    }
+
+    // The journal only records segments that were read back in full
+    if (cmdopts.checkpoint && cmdopts.action == WRITE &&
+        cmdopts.verify_mode != VERIFY_FULL) {
+      fprintf(stderr,
+              "--verify_mode can't be used with --checkpoint or --resume "
+              "when writing.\n");
+      print_help_and_exit(argv[0]);
+    }
+
     // don't permit skipping the ID read in write/erase-mode or ID only mode
     if ((cmdopts.action == WRITE || cmdopts.action == ERASE ||
-         cmdopts.idcheck_only) &&
+         cmdopts.bench_write || cmdopts.resume || cmdopts.idcheck_only) &&
         cmdopts.idcheck_skip) {
       fprintf(stderr,
               "Skipping the ID check is not permitted for this action.\n");
@@ -2319,7 +3530,7 @@ int action_verify(minipro_handle_t *handle) {
 
     // Exit if no action is supplied
     if (cmdopts.action == NO_ACTION && !cmdopts.idcheck_only &&
-        !cmdopts.pincheck) {
+        !cmdopts.pincheck && !job.count && !cmdopts.daemon) {
       fprintf(stderr, "No action to perform.\n");
       print_help_and_exit(argv[0]);
     }
@@ -2328,8 +3539,11 @@ int action_verify(minipro_handle_t *handle) {
     if (cmdopts.filename)
     	cmdopts.is_pipe = (!strcmp(cmdopts.filename, "-"));
 
-    minipro_handle_t *handle = minipro_open(cmdopts.device, VERBOSE);
+    minipro_handle_t *handle =
+        minipro_open_programmer(cmdopts.device, cmdopts.usb, VERBOSE);
     if (!handle) return EXIT_FAILURE;
+    handle->progress_cb = print_progress;
+    handle->error_cb = print_error;
 
     // Exit if bootloader is active
     minipro_print_system_info(handle);
@@ -2341,6 +3555,15 @@ int action_verify(minipro_handle_t *handle) {
 
     // Parse programming options
     handle->cmdopts = &cmdopts;
+    saved_argc = argc;
+    saved_argv = argv;
+#ifndef _WIN32
+    if (cmdopts.daemon) {
+      int ret = run_daemon(handle, cmdopts.daemon);
+      minipro_close(handle);
+      return ret;
+    }
+#endif
     if (parse_options(handle, argc, argv)) {
       if(strlen(optarg)) fprintf(stderr, "Invalid option '%s'\n", optarg);
       minipro_close(handle);
@@ -2356,196 +3579,41 @@ int action_verify(minipro_handle_t *handle) {
         }
       } else
         fprintf(stderr, "Pin test is not supported.\n");
-      if (cmdopts.action == NO_ACTION && !cmdopts.idcheck_only)
+      if (cmdopts.action == NO_ACTION && !cmdopts.idcheck_only && !job.count)
         return EXIT_SUCCESS;
     }
 
-    // Check for GAL/PLD
-    if (!is_pld(handle->device->protocol_id) &&
-        (!handle->device->read_buffer_size || !handle->device->protocol_id)) {
+    if (prepare_device(handle)) {
       minipro_close(handle);
-      fprintf(stderr, "Unsupported device!\n");
       return EXIT_FAILURE;
     }
 
-    // Unlocking the TSOP48 adapter (if applicable)
-    uint8_t status;
-    switch (handle->device->package_details & ADAPTER_MASK) {
-      case TSOP48_ADAPTER:
-      case SOP44_ADAPTER:
-      case SOP56_ADAPTER:
-        if (minipro_unlock_tsop48(handle, &status)) {
-          minipro_close(handle);
-          return EXIT_FAILURE;
-        }
-        switch (status) {
-          case MP_TSOP48_TYPE_V3:
-            fprintf(stderr, "Found TSOP adapter V3\n");
-            break;
-          case MP_TSOP48_TYPE_NONE:
-            minipro_end_transaction(handle);  // We need this to turn off the
-                                              // power on the ZIF socket.
-            minipro_close(handle);
-            fprintf(stderr, "TSOP adapter not found!\n");
-            return EXIT_FAILURE;
-          case MP_TSOP48_TYPE_V0:
-            fprintf(stderr, "Found TSOP adapter V0\n");
-            break;
-          case MP_TSOP48_TYPE_FAKE1:
-          case MP_TSOP48_TYPE_FAKE2:
-            fprintf(stderr, "Fake TSOP adapter found!\n");
-            break;
-        }
-        minipro_end_transaction(handle);
-        break;
+    // The chip is checked for every insertion
+    if (cmdopts.loop) {
+      int ret = run_loop(handle, &job, split);
+      free_job(&job);
+      minipro_close(handle);
+      return ret;
     }
 
-    // Activate ICSP if the chip can only be programmed via ICSP.
-    handle->icsp = 0;
-    if ((handle->device->package_details & ICSP_MASK) &&
-        ((handle->device->package_details & PIN_COUNT_MASK) == 0)) {
-      handle->icsp = MP_ICSP_ENABLE | MP_ICSP_VCC;
-    } else if (handle->device->package_details & ICSP_MASK)
-      handle->icsp = cmdopts.icsp;
-    if (handle->icsp) fprintf(stderr, "Activating ICSP...\n");
-
-    uint8_t id_type;
-    // Verifying Chip ID (if applicable)
-    if (cmdopts.idcheck_skip) {
-      fprintf(stderr, "WARNING: skipping Chip ID test\n");
-    } else if ((handle->device->chip_id_bytes_count &&
-                handle->device->chip_id) &&
-               (handle->device->opts4 & MP_ID_MASK)) {
-      if (minipro_begin_transaction(handle)) {
-        minipro_close(handle);
-        return EXIT_FAILURE;
-      }
-      uint32_t chip_id;
-      if (minipro_get_chip_id(handle, &id_type, &chip_id)) {
-        minipro_close(handle);
-        return EXIT_FAILURE;
-      }
-      if (minipro_end_transaction(handle)) {
-        minipro_close(handle);
-        return EXIT_FAILURE;
-      }
-      uint32_t chip_id_temp = chip_id;
-      uint8_t shift = 0;
-      /* The id_type will tell us the Chip ID type. There are 5 types */
-      uint32_t ok = 0;
-      switch (id_type) {
-        case MP_ID_TYPE1:  // 1-3 bytes ID
-        case MP_ID_TYPE2:  // 4 bytes ID
-        case MP_ID_TYPE5:  // 3 bytes ID, this ID type is returning from 25 SPI
-                           // series.
-          ok = (chip_id == handle->device->chip_id);
-          if (ok) {
-            fprintf(stderr, "Chip ID OK: 0x%04X\n", chip_id);
-          }
-          break;
-        case MP_ID_TYPE3:  // Microchip controllers with 5 bit revision number.
-          ok = (handle->device->chip_id >> 5 ==
-                (chip_id >> 5));  // Throw the chip revision (last 5 bits).
-          if (ok) {
-            fprintf(stderr, "Chip ID OK: 0x%04X Rev.0x%02X\n", chip_id >> 5,
-                    chip_id & 0x1F);
-          }
-          chip_id >>= 5;
-          chip_id_temp = chip_id << 5;
-          shift = 5;
-          break;
-        case MP_ID_TYPE4:  // Microchip controllers with 4-5 bit revision
-                           // number.
-          ok = (handle->device->chip_id >>
-                    ((fuse_decl_t *)handle->device->config)->rev_mask ==
-                (chip_id >> ((fuse_decl_t *)handle->device->config)
-                                ->rev_mask));  // Throw the chip revision (last
-                                               // rev_mask bits).
-          if (ok) {
-            fprintf(
-                stderr, "Chip ID OK: 0x%04X Rev.0x%02X\n",
-                chip_id >> ((fuse_decl_t *)handle->device->config)->rev_mask,
-                chip_id & ~(0xFF << ((fuse_decl_t *)handle->device->config)
-                                        ->rev_mask));
-          }
-          chip_id >>= ((fuse_decl_t *)handle->device->config)->rev_mask;
-          chip_id_temp = chip_id
-                         << ((fuse_decl_t *)handle->device->config)->rev_mask;
-          shift = ((fuse_decl_t *)handle->device->config)->rev_mask;
-          break;
-      }
-
-      if (cmdopts.idcheck_only && ok) {
-        minipro_close(handle);
-        return EXIT_SUCCESS;
-      }
-
-      if (!ok) {
-        const char *name = get_device_from_id(handle->version, chip_id_temp,
-                                              handle->device->protocol_id);
-        if (cmdopts.idcheck_only) {
-          fprintf(stderr,
-                  "Chip ID mismatch: expected 0x%04X, got 0x%04X (%s)\n",
-                  handle->device->chip_id >> shift, chip_id_temp >> shift,
-                  name ? name : "unknown");
-          minipro_close(handle);
-          if(name) free((char*)name);
-          return EXIT_FAILURE;
-        }
-        if (cmdopts.idcheck_continue) {
-          fprintf(
-              stderr,
-              "WARNING: Chip ID mismatch: expected 0x%04X, got 0x%04X (%s)\n",
-              handle->device->chip_id >> shift, chip_id_temp >> shift,
-              name ? name : "unknown");
-        } else {
-          fprintf(
-              stderr,
-              "Invalid Chip ID: expected 0x%04X, got 0x%04X (%s)\n(use '-y' "
-              "to continue anyway at your own risk)\n",
-              handle->device->chip_id >> shift, chip_id_temp,
-              name ? name : "unknown");
-          minipro_close(handle);
-          if(name) free((char*)name);
-          return EXIT_FAILURE;
-        }
-        if(name) free((char*)name);
-      }
-    } else if (cmdopts.idcheck_only) {
+    if (check_chip_id(handle)) {
       minipro_close(handle);
-      fprintf(stderr, "This chip doesn't have a chip id!\n");
       return EXIT_FAILURE;
     }
+    if (cmdopts.idcheck_only) {
+      minipro_close(handle);
+      return EXIT_SUCCESS;
+    }
 
     // Performing requested action
     int ret;
-    switch (cmdopts.action) {
-      case READ:
-        ret = action_read(handle);
-        break;
-      case WRITE:
-        ret = action_write(handle);
-        break;
-      case VERIFY:
-      case BLANK_CHECK:
-        ret = action_verify(handle);
-        break;
-      case ERASE:
-        if (!(handle->device->opts4 & MP_ERASE_MASK)) {
-          fprintf(stderr, "This chip can't be erased!\n");
-          minipro_close(handle);
-          return EXIT_FAILURE;
-        }
-        if (minipro_begin_transaction(handle)) {
-          minipro_close(handle);
-          return EXIT_FAILURE;
-        }
-        ret = erase_device(handle);
-        break;
-      default:
-        ret = EXIT_FAILURE;
-        break;
-    }
+    if (job.count)
+      ret = run_job(handle, &job);
+    else if (split && split->only < 0)
+      ret = run_split(handle, split);
+    else
+      ret = run_action(handle);
+    free_job(&job);
 
     if (minipro_end_transaction(handle)) {
       minipro_close(handle);
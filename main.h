@@ -0,0 +1,48 @@
+/*
+ * main.h - Declarations of the high-level operations shared with the
+ *		other command line modules.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef MAIN_H_
+#define MAIN_H_
+
+#include <stdint.h>
+#include "minipro.h"
+
+#ifdef _WIN32
+	#define PRI_SIZET  "Iu"
+#else
+	#define PRI_SIZET  "zu"
+#endif
+
+int is_pld(uint8_t protocol_id);
+
+// Get a monotonic timestamp in microseconds
+uint64_t get_usec(void);
+
+// Apply the -o options of the command line to the current device
+int apply_options(minipro_handle_t *handle);
+
+// Switch the handle to another device and check the inserted chip
+int select_device(minipro_handle_t *handle, const char *name);
+
+// Verify the chip ID (if applicable)
+int check_chip_id(minipro_handle_t *handle);
+
+// Run the action of the command line options on the current device
+int run_action(minipro_handle_t *handle);
+
+#endif /* MAIN_H_ */
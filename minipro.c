@@ -16,12 +16,16 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "database.h"
 #include "minipro.h"
 #include "tl866a.h"
@@ -31,7 +35,6 @@
 #define TL866A_RESET 0xFF
 #define TL866IIPLUS_RESET 0x3F
 
-#define CRC32_POLYNOMIAL 0xEDB88320
 
 
 void format_int(uint8_t *out, uint32_t in, size_t size, uint8_t endianness) {
@@ -53,19 +56,103 @@ uint32_t load_int(uint8_t *buffer, size_t size, uint8_t endianness) {
   return result;
 }
 
-// Simple crc32
-uint32_t crc32(uint8_t *data, size_t size, uint32_t initial) {
-  uint32_t i, j, crc;
-  crc = initial;
-  for (i = 0; i < size; i++) {
-    crc = crc ^ data[i];
-    for (j = 0; j < 8; j++)
-      crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & (-(crc & 1)));
-  }
+// CRC32 (polynomial 0xEDB88320) of every byte value
+static const uint32_t crc32_table[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d};
+
+// Table driven crc32, without the initial and final inversion
+uint32_t minipro_crc32(uint8_t *data, size_t size, uint32_t initial) {
+  size_t i;
+  uint32_t crc = initial;
+  for (i = 0; i < size; i++)
+    crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
   return crc;
 }
 
-minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose) {
+// Per handle xorshift32 generator, rand() is shared by all threads
+uint8_t minipro_random(minipro_handle_t *handle) {
+  uint32_t x = handle->random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  handle->random_state = x;
+  return (uint8_t)(x >> 24);
+}
+
+// The cache directory, $XDG_CACHE_HOME/minipro or ~/.cache/minipro,
+// created if needed. NULL if there is none.
+char *minipro_cache_dir(void) {
+#ifdef _WIN32
+  return NULL;
+#else
+  const char *base = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  char *dir;
+
+  if (base && *base) {
+    dir = malloc(strlen(base) + sizeof("/minipro"));
+    if (!dir) return NULL;
+    sprintf(dir, "%s/minipro", base);
+  } else if (home && *home) {
+    dir = malloc(strlen(home) + sizeof("/.cache/minipro"));
+    if (!dir) return NULL;
+    sprintf(dir, "%s/.cache", home);
+    mkdir(dir, 0700);
+    strcat(dir, "/minipro");
+  } else
+    return NULL;
+  if (mkdir(dir, 0700) && errno != EEXIST) {
+    free(dir);
+    return NULL;
+  }
+  return dir;
+#endif
+}
+
+// Open the index-th connected programmer, without selecting a device
+minipro_handle_t *minipro_open_index(int index, uint8_t verbose) {
   minipro_handle_t *handle = malloc(sizeof(minipro_handle_t));
   if (handle == NULL) {
     if(verbose)
@@ -73,14 +160,26 @@ minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose) {
     return NULL;
   }
 
-  handle->usb_handle = usb_open(verbose);
+  handle->progress_cb = NULL;
+  handle->error_cb = NULL;
+  handle->cb_data = NULL;
+  // Must never be zero
+  handle->random_state = (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)handle;
+  if (!handle->random_state) handle->random_state = 0x2545F491;
+
+  handle->device = NULL;
+  handle->usb_handle = usb_open(index, verbose);
   if (!handle->usb_handle) {
     free(handle);
     return NULL;
   }
+  usb_location(handle->usb_handle, handle->location, sizeof(handle->location));
 
   minipro_report_info_t info;
-  if (minipro_get_system_info(handle, &info)) return NULL;
+  if (minipro_get_system_info(handle, &info)) {
+    minipro_close(handle);
+    return NULL;
+  }
 
   switch (info.device_version) {
     case MP_TL866A:
@@ -99,6 +198,7 @@ minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose) {
       handle->model = info.device_version == MP_TL866A ? "TL866A" : "TL866CS";
       memcpy(handle->device_code, info.device_code, 8);
       memcpy(handle->serial_number, info.serial_number, 24);
+      handle->serial_number[24] = '\0';
       handle->minipro_begin_transaction = tl866a_begin_transaction;
       handle->minipro_end_transaction = tl866a_end_transaction;
       handle->minipro_protect_off = tl866a_protect_off;
@@ -117,6 +217,7 @@ minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose) {
       handle->minipro_write_jedec_row = tl866a_write_jedec_row;
       handle->minipro_firmware_update = tl866a_firmware_update;
       handle->minipro_pin_test = NULL;
+      handle->minipro_chip_present = NULL;
       break;
     case MP_TL866IIPLUS:
       handle->status = info.firmware_version_minor == 0 ? MP_STATUS_BOOTLOADER
@@ -124,6 +225,7 @@ minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose) {
       handle->model = "TL866II+";
       memcpy(handle->device_code, info.device_code, 8);
       memcpy(handle->serial_number, info.serial_number, 20);
+      handle->serial_number[20] = '\0';
       handle->minipro_begin_transaction = tl866iiplus_begin_transaction;
       handle->minipro_end_transaction = tl866iiplus_end_transaction;
       handle->minipro_get_chip_id = tl866iiplus_get_chip_id;
@@ -142,6 +244,7 @@ minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose) {
       handle->minipro_write_jedec_row = tl866iiplus_write_jedec_row;
       handle->minipro_firmware_update = tl866iiplus_firmware_update;
       handle->minipro_pin_test = tl866iiplus_pin_test;
+      handle->minipro_chip_present = tl866iiplus_chip_present;
       break;
     default:
       minipro_close(handle);
@@ -155,8 +258,47 @@ minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose) {
   sprintf(handle->firmware_str, "%02d.%d.%d", info.hardware_version,
           info.firmware_version_major, info.firmware_version_minor);
   handle->version = info.device_version;
+  handle->device_code[8] = '\0';
+  size_t len = strlen(handle->serial_number);
+  while (len && isspace((unsigned char)handle->serial_number[len - 1]))
+    handle->serial_number[--len] = '\0';
+  return handle;
+}
+
+/* Open a programmer and select device_name on it. With several programmers
+ * connected, programmer picks one by its usb location or serial number;
+ * NULL takes the first one that isn't in use.
+ */
+minipro_handle_t *minipro_open_programmer(const char *device_name,
+                                          const char *programmer,
+                                          uint8_t verbose) {
+  minipro_handle_t *handle = NULL;
+  int i, count = minipro_get_devices_count(MP_TL866A) +
+              minipro_get_devices_count(MP_TL866IIPLUS);
+
+  if (!programmer && count <= 1) {
+    handle = minipro_open_index(0, verbose);
+    if (!handle) return NULL;
+  } else {
+    for (i = 0; i < count && !handle; i++) {
+      handle = minipro_open_index(i, NO_VERBOSE);
+      if (handle && programmer && strcmp(programmer, handle->location) &&
+          strcmp(programmer, handle->serial_number)) {
+        minipro_close(handle);
+        handle = NULL;
+      }
+    }
+    if (!handle) {
+      if (verbose) {
+        if (programmer)
+          fprintf(stderr, "Programmer %s not found!\n", programmer);
+        else
+          fprintf(stderr, "No programmer found.\n");
+      }
+      return NULL;
+    }
+  }
 
-  handle->device = NULL;
   if (device_name != NULL) {
     handle->device = get_device_by_name(handle->version, device_name);
     if (handle->device == NULL) {
@@ -169,6 +311,10 @@ minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose) {
   return handle;
 }
 
+minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose) {
+  return minipro_open_programmer(device_name, NULL, verbose);
+}
+
 void minipro_close(minipro_handle_t *handle) {
   usb_close(handle->usb_handle);
   if(handle->device) free(handle->device);
@@ -491,3 +637,14 @@ int minipro_pin_test(minipro_handle_t *handle) {
 	  }
 	  return EXIT_FAILURE;
 }
+
+// Chip insertion detection
+int minipro_chip_present(minipro_handle_t *handle, uint8_t *status) {
+  assert(handle != NULL);
+  if (handle->minipro_chip_present) {
+    return handle->minipro_chip_present(handle, status);
+  } else {
+    fprintf(stderr, "%s: chip detection not implemented\n", handle->model);
+  }
+  return EXIT_FAILURE;
+}
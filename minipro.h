@@ -45,6 +45,10 @@
 #define MP_TSOP48_TYPE_FAKE1 0x03
 #define MP_TSOP48_TYPE_FAKE2 0x04
 
+#define MP_CHIP_ABSENT 0x00
+#define MP_CHIP_PARTIAL 0x01
+#define MP_CHIP_PRESENT 0x02
+
 #define MP_ID_TYPE1 0x01
 #define MP_ID_TYPE2 0x02
 #define MP_ID_TYPE3 0x03
@@ -161,7 +165,7 @@ typedef struct cmdopts_s {
   char *filename;
   char *device;
   enum { UNSPECIFIED = 0, CODE, DATA, CONFIG } page;
-  enum { NO_ACTION = 0, READ, WRITE, ERASE, VERIFY, BLANK_CHECK } action;
+  enum { NO_ACTION = 0, READ, WRITE, ERASE, VERIFY, BLANK_CHECK, BENCHMARK } action;
   enum { NO_FORMAT = 0, IHEX, SREC} format;
   uint8_t no_erase;
   uint8_t no_protect_off;
@@ -176,6 +180,33 @@ typedef struct cmdopts_s {
   uint8_t pincheck;
   uint8_t is_pipe;
   uint8_t version;
+  uint8_t bench_write;
+  uint32_t bench_passes;
+  uint8_t checkpoint;
+  uint8_t resume;
+  char *job;
+  char *daemon;
+  uint8_t loop;
+  uint8_t compress;
+  enum {
+    VERIFY_FULL = 0,
+    VERIFY_CHECKSUM,
+    VERIFY_SAMPLE,
+    VERIFY_DEVICE
+  } verify_mode;
+  uint32_t verify_stride;
+  char *serial;
+  char *split;
+  uint8_t transform;
+  uint32_t image_cache;  // image cache size limit in MiB, 0 if disabled
+  int64_t offset;        // added to the hex/srec file addresses
+  uint8_t unfill;        // leave runs of unfill_value out of the file read
+  uint8_t unfill_value;
+  size_t unfill_run;
+  size_t row_size;       // data bytes per hex/srec record
+  size_t line_length;
+  uint8_t hash;          // HASH_* of the memory read
+  char *usb;             // usb location or serial number of the programmer
 } cmdopts_t;
 
 typedef struct minipro_handle {
@@ -183,6 +214,7 @@ typedef struct minipro_handle {
   char firmware_str[16];
   char device_code[9];
   char serial_number[25];
+  char location[256];    // usb_location() of the programmer
   uint32_t firmware;
   uint8_t status;
   uint8_t version;
@@ -192,6 +224,7 @@ typedef struct minipro_handle {
 
   void *usb_handle;
   cmdopts_t *cmdopts;
+  uint32_t random_state;
 
   int (*minipro_begin_transaction)(struct minipro_handle *);
   int (*minipro_end_transaction)(struct minipro_handle *);
@@ -218,6 +251,13 @@ typedef struct minipro_handle {
                                 uint8_t, size_t);
   int (*minipro_firmware_update)(struct minipro_handle *, const char *);
   int (*minipro_pin_test)(struct minipro_handle *);
+  int (*minipro_chip_present)(struct minipro_handle *, uint8_t *);
+
+  // Reporting of the operations in operations.c (optional). The USB and
+  // programmer layers still print their errors to stderr.
+  void (*progress_cb)(void *, size_t, size_t);
+  void (*error_cb)(void *, const char *);
+  void *cb_data;
 } minipro_handle_t;
 
 typedef struct minipro_report_info {
@@ -243,7 +283,9 @@ uint32_t load_int(uint8_t *buffer, size_t size, uint8_t endianness);
 int minipro_get_system_info(minipro_handle_t *handle,
                             minipro_report_info_t *info);
 void minipro_print_system_info(minipro_handle_t *handle);
-uint32_t crc32(uint8_t *data, size_t size, uint32_t initial);
+uint32_t minipro_crc32(uint8_t *data, size_t size, uint32_t initial);
+uint8_t minipro_random(minipro_handle_t *handle);
+char *minipro_cache_dir(void);
 int minipro_reset(minipro_handle_t *handle);
 int minipro_get_devices_count(uint8_t version);
 
@@ -256,6 +298,10 @@ int minipro_get_devices_count(uint8_t version);
  * state.
  */
 minipro_handle_t *minipro_open(const char *device_name, uint8_t verbose);
+minipro_handle_t *minipro_open_programmer(const char *device_name,
+                                          const char *programmer,
+                                          uint8_t verbose);
+minipro_handle_t *minipro_open_index(int index, uint8_t verbose);
 void minipro_close(minipro_handle_t *handle);
 int minipro_begin_transaction(minipro_handle_t *handle);
 int minipro_end_transaction(minipro_handle_t *handle);
@@ -284,5 +330,6 @@ int minipro_unlock_tsop48(minipro_handle_t *handle, uint8_t *status);
 int minipro_hardware_check(minipro_handle_t *handle);
 int minipro_firmware_update(minipro_handle_t *handle, const char *firmware);
 int minipro_pin_test(minipro_handle_t *handle);
+int minipro_chip_present(minipro_handle_t *handle, uint8_t *status);
 
 #endif
@@ -0,0 +1,431 @@
+/*
+ * operations.c - Memory and PLD operations of the library.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "database.h"
+#include "operations.h"
+
+static void report_error(minipro_handle_t *handle, const char *fmt, ...) {
+  char message[128];
+  va_list args;
+
+  if (!handle->error_cb) return;
+  va_start(args, fmt);
+  vsnprintf(message, sizeof(message), fmt, args);
+  va_end(args);
+  handle->error_cb(handle->cb_data, message);
+}
+
+static void report_progress(minipro_handle_t *handle, size_t done,
+                            size_t total) {
+  if (handle->progress_cb) handle->progress_cb(handle->cb_data, done, total);
+}
+
+static int check_ovc(minipro_handle_t *handle, minipro_status_t *status) {
+  uint8_t ovc = 0;
+  if (minipro_get_ovc_status(handle, status, &ovc)) return EXIT_FAILURE;
+  if (ovc) {
+    report_error(handle, "Overcurrent protection!");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// Translating address to protocol-specific
+static uint32_t block_address(minipro_handle_t *handle, uint8_t type,
+                              size_t offset) {
+  if ((handle->device->opts4 & MP_DATA_BUS_WIDTH) && type == MP_CODE)
+    return offset >> 1;
+  return offset;
+}
+
+//Helper function to check for PIC devices
+int is_pic(minipro_handle_t *handle) {
+  if(handle->version == MP_TL866A) {
+    switch (handle->device->protocol_id) {
+      case TL866A_PIC_PROTOCOL_1:
+      case TL866A_PIC_PROTOCOL_2:
+      case TL866A_PIC_PROTOCOL_3:
+      case TL866A_PIC_PROTOCOL_4:
+      case TL866A_PIC_PROTOCOL_PIC18:
+      case TL866A_PIC_PROTOCOL_PIC18_ICSP:
+        return 1;
+    }
+  }
+  else if(handle->version == MP_TL866IIPLUS) {
+    switch (handle->device->protocol_id) {
+      case TL866IIP_PIC_PROTOCOL_1:
+      case TL866IIP_PIC_PROTOCOL_2:
+      case TL866IIP_PIC_PROTOCOL_3:
+      case TL866IIP_PIC_PROTOCOL_4:
+      case TL866IIP_PIC_PROTOCOL_PIC18:
+      case TL866IIP_PIC_PROTOCOL_PIC18_ICSP:
+        return 1;
+    }
+  }
+  return 0;
+}
+
+size_t get_pic_word_width(minipro_handle_t *handle) {
+  if(is_pic(handle)) {
+    switch(handle->device->opts7 & PIC_INSTR_WORD_WIDTH_MASK) {
+      case PIC_INSTR_WORD_WIDTH_12:
+        return 12;
+        break;
+
+      case PIC_INSTR_WORD_WIDTH_14:
+        return 14;
+        break;
+
+      case PIC_INSTR_WORD_WIDTH_16_PIC18F:
+      case PIC_INSTR_WORD_WIDTH_16_PIC18J:
+        return 16;
+        break;
+    }
+  }
+
+  return 0;  
+}
+
+// will return 0 when mask doesn't require masked compare
+uint16_t get_compare_mask(minipro_handle_t *handle, uint8_t type) {
+  if(type == MP_CODE) { // only code memory, not data memory
+    size_t wordlen = get_pic_word_width(handle);
+    if(wordlen > 0 && wordlen < 16)
+      return (0xffffUL >> (16-wordlen));
+  }
+  
+  return 0;
+}
+
+// returned value will be a byte offset
+// sizes are in bytes
+// replacement_value needs to be in native byte order
+// sizes can be odd
+int compare_word_memory(uint16_t replacement_value,
+      uint16_t compare_mask, uint8_t little_endian,
+      uint8_t *s1, uint8_t *s2, size_t size1, size_t size2,
+      uint16_t *c1, uint16_t *c2) {
+  size_t i;
+  uint16_t v1, v2;
+  size_t size = (size1 > size2) ? size1 : size2;
+  if(compare_mask == 0) compare_mask = 0xffff;
+  uint8_t rvl =  (replacement_value & compare_mask)       & 0xff;
+  uint8_t rvh = ((replacement_value & compare_mask) >> 8) & 0xff;
+
+  for (i = 0; i < size; i +=2 ) {
+    if(little_endian) {
+      v1 = (i < size1) ? s1[i] : rvl;
+      v1 |= (((i + 1) < size1) ? s1[i + 1] : rvh) << 8;
+      v2 = (i < size2) ? s2[i] : rvl;
+      v2 |= (((i + 1) < size2) ? s2[i + 1] : rvh) << 8;
+    }
+    else {
+      v1 = ((i < size1) ? s1[i] : rvh) << 8;
+      v1 |= ((i + 1) < size1) ? (s1[i + 1]) : rvl;
+      v2 = ((i < size2) ? s2[i] : rvh) << 8;
+      v2 |= ((i + 1) < size2) ? (s2[i + 1]) : rvl;
+    }
+    if ((v1 & compare_mask) != (v2 & compare_mask)) {
+      *c1 = v1;
+      *c2 = v2;
+      return i;
+    }
+  }
+  return -1;
+}
+
+int minipro_read_sampled(minipro_handle_t *handle, uint8_t type,
+                         size_t start, size_t size, size_t stride,
+                         minipro_block_cb consume, void *ctx) {
+  size_t offset, len = handle->device->read_buffer_size;
+  size_t last = start < size ? start + (size - start - 1) / len * len : start;
+
+  uint8_t *block = malloc(len + 128);
+  if (!block) {
+    report_error(handle, "Out of memory");
+    return EXIT_FAILURE;
+  }
+
+  report_progress(handle, start, size);
+  for (offset = start; offset < size; offset += len) {
+    // Every stride-th block and the last one
+    if ((offset - start) / len % stride && offset != last) continue;
+    if (minipro_read_block(handle, type, block_address(handle, type, offset),
+                           block, len) ||
+        check_ovc(handle, NULL) ||
+        consume(ctx, block, offset, size - offset < len ? size - offset : len)) {
+      free(block);
+      return EXIT_FAILURE;
+    }
+    report_progress(handle, size - offset < len ? size : offset + len, size);
+  }
+  free(block);
+  return EXIT_SUCCESS;
+}
+
+int minipro_read_stream(minipro_handle_t *handle, uint8_t type, size_t start,
+                        size_t size, minipro_block_cb consume, void *ctx) {
+  return minipro_read_sampled(handle, type, start, size, 1, consume, ctx);
+}
+
+int minipro_write_source(minipro_handle_t *handle, uint8_t type, size_t start,
+                         size_t size, uint8_t check_status,
+                         minipro_block_cb fill, minipro_block_cb written,
+                         void *ctx) {
+  minipro_status_t status;
+  size_t offset, len = handle->device->write_buffer_size;
+
+  uint8_t *block = malloc(len);
+  if (!block) {
+    report_error(handle, "Out of memory");
+    return EXIT_FAILURE;
+  }
+
+  report_progress(handle, start, size);
+  for (offset = start; offset < size; offset += len) {
+    // Last block
+    if (offset + len > size) len = size - offset;
+    if (fill(ctx, block, offset, len) ||
+        minipro_write_block(handle, type, block_address(handle, type, offset),
+                            block, len) ||
+        check_ovc(handle, &status)) {
+      free(block);
+      return EXIT_FAILURE;
+    }
+    if (status.error && check_status) {
+      free(block);
+      report_error(handle,
+                   "Verification failed at address 0x%04X: File=0x%02X, "
+                   "Device=0x%02X",
+                   status.address,
+                   status.c2 & (WORD_SIZE(handle->device) == 1 ? 0xFF : 0xFFFF),
+                   status.c1 & (WORD_SIZE(handle->device) == 1 ? 0xFF : 0xFFFF));
+      return EXIT_FAILURE;
+    }
+    if (written && written(ctx, block, offset, len)) {
+      free(block);
+      return EXIT_FAILURE;
+    }
+    report_progress(handle, offset + len, size);
+  }
+  free(block);
+  return EXIT_SUCCESS;
+}
+
+typedef struct memory_source_s {
+  uint8_t *buffer;
+  minipro_block_cb written;
+  void *ctx;
+} memory_source_t;
+
+static int fill_from_memory(void *ctx, uint8_t *block, size_t offset,
+                            size_t len) {
+  memcpy(block, ((memory_source_t *)ctx)->buffer + offset, len);
+  return EXIT_SUCCESS;
+}
+
+static int memory_written(void *ctx, uint8_t *block, size_t offset,
+                          size_t len) {
+  memory_source_t *source = ctx;
+  if (!source->written) return EXIT_SUCCESS;
+  return source->written(source->ctx, block, offset, len);
+}
+
+int minipro_write_stream(minipro_handle_t *handle, uint8_t *buffer,
+                         uint8_t type, size_t start, size_t size,
+                         uint8_t check_status, minipro_block_cb written,
+                         void *ctx) {
+  memory_source_t source = {buffer, written, ctx};
+  return minipro_write_source(handle, type, start, size, check_status,
+                              fill_from_memory, memory_written, &source);
+}
+
+static int copy_block(void *ctx, uint8_t *block, size_t offset, size_t len) {
+  memcpy((uint8_t *)ctx + offset, block, len);
+  return EXIT_SUCCESS;
+}
+
+int minipro_read_memory(minipro_handle_t *handle, uint8_t type,
+                        uint8_t *buffer, size_t size) {
+  return minipro_read_stream(handle, type, 0, size, copy_block, buffer);
+}
+
+int minipro_write_memory(minipro_handle_t *handle, uint8_t type,
+                         uint8_t *buffer, size_t size, uint8_t check_status) {
+  return minipro_write_stream(handle, buffer, type, 0, size, check_status,
+                              NULL, NULL);
+}
+
+typedef struct verify_s {
+  uint8_t *buffer;
+  uint16_t compare_mask;
+  int64_t address;
+} verify_t;
+
+static int compare_block(void *ctx, uint8_t *block, size_t offset,
+                         size_t len) {
+  verify_t *verify = ctx;
+  uint16_t c1, c2;
+  size_t i;
+  int idx;
+
+  if (verify->address != -1) return EXIT_SUCCESS;
+  if (verify->compare_mask) {
+    idx = compare_word_memory(0xffff, verify->compare_mask, 1,
+                              verify->buffer + offset, block, len, len, &c1,
+                              &c2);
+    if (idx != -1) verify->address = offset + idx;
+    return EXIT_SUCCESS;
+  }
+  for (i = 0; i < len; i++) {
+    if (block[i] != verify->buffer[offset + i]) {
+      verify->address = offset + i;
+      break;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+int minipro_verify_memory(minipro_handle_t *handle, uint8_t type,
+                          uint8_t *buffer, size_t size, int64_t *address) {
+  verify_t verify = {buffer, get_compare_mask(handle, type), -1};
+  if (minipro_read_stream(handle, type, 0, size, compare_block, &verify))
+    return EXIT_FAILURE;
+  *address = verify.address;
+  return EXIT_SUCCESS;
+}
+
+int minipro_read_pld(minipro_handle_t *handle, jedec_t *jedec) {
+  size_t i, j;
+  uint8_t buffer[32];
+  gal_config_t *config = (gal_config_t *)handle->device->config;
+  size_t row_size = (config->row_width + 7) / 8;
+
+  if (check_ovc(handle, NULL)) return EXIT_FAILURE;
+
+  // Read fuses
+  memset(jedec->fuses, 0, jedec->QF);
+  report_progress(handle, 0, config->fuses_size * row_size);
+  for (i = 0; i < config->fuses_size; i++) {
+    if (minipro_read_jedec_row(handle, buffer, i, 0, config->row_width))
+      return EXIT_FAILURE;
+    // Unpacking the row
+    for (j = 0; j < config->row_width; j++) {
+      if (buffer[j / 8] & (0x80 >> (j & 0x07)))
+        jedec->fuses[config->fuses_size * j + i] = 1;
+    }
+    report_progress(handle, (i + 1) * row_size,
+                    config->fuses_size * row_size);
+  }
+
+  // Read user electronic signature (UES)
+  // UES data can be missing in jedec, e.g. for db entry "ATF22V10C"
+  if((config->ues_address != 0) && (config->ues_size != 0)
+        && ((config->ues_address + config->ues_size) <= jedec->QF)
+        && !(handle->device->opts1 & ATF_IN_PAL_COMPAT_MODE)) {
+    if (minipro_read_jedec_row(handle, buffer, i, 0, config->ues_size))
+     return EXIT_FAILURE;
+    for (j = 0; j < config->ues_size; j++) {
+      if (buffer[j / 8] & (0x80 >> (j & 0x07)))
+        jedec->fuses[config->ues_address + j] = 1;
+    }
+  }
+
+  // Read architecture control word (ACW)
+  if (minipro_read_jedec_row(handle, buffer, config->acw_address,
+        config->acw_address, config->acw_size))
+    return EXIT_FAILURE;
+  for (i = 0; i < config->acw_size; i++) {
+    if (buffer[i / 8] & (0x80 >> (i & 0x07)))
+      jedec->fuses[config->acw_bits[i]] = 1;
+  }
+
+  // Read Power-Down bit
+  if((config->powerdown_row != 0)
+      && (handle->device->opts1 & LAST_JEDEC_BIT_IS_POWERDOWN_ENABLE)) {
+    if (minipro_read_jedec_row(handle, buffer, config->powerdown_row, 0, 1))
+      return EXIT_FAILURE;
+    jedec->fuses[jedec->QF - 1] = (buffer[0] >> 7) & 0x01;
+  }
+  return EXIT_SUCCESS;
+}
+
+int minipro_write_pld(minipro_handle_t *handle, jedec_t *jedec) {
+  size_t i, j;
+  uint8_t buffer[32];
+  gal_config_t *config = (gal_config_t *)handle->device->config;
+  size_t row_size = (config->row_width + 7) / 8;
+
+  if (check_ovc(handle, NULL)) return EXIT_FAILURE;
+
+  // Write fuses
+  report_progress(handle, 0, config->fuses_size * row_size);
+  for (i = 0; i < config->fuses_size; i++) {
+    memset(buffer, 0, sizeof(buffer));
+    // Building a row
+    for (j = 0; j < config->row_width; j++) {
+      if (jedec->fuses[config->fuses_size * j + i] == 1)
+        buffer[j / 8] |= (0x80 >> (j & 0x07));
+    }
+    if (minipro_write_jedec_row(handle, buffer, i, 0, config->row_width))
+      return EXIT_FAILURE;
+    report_progress(handle, (i + 1) * row_size,
+                    config->fuses_size * row_size);
+  }
+
+  // Write user electronic signature (UES)
+  memset(buffer, 0, sizeof(buffer));
+  // UES data can be missing in jedec, e.g. for db entry "ATF22V10C"
+  if((config->ues_address != 0) && (config->ues_size != 0)
+        && ((config->ues_address + config->ues_size) <= jedec->QF)
+        && !(handle->device->opts1 & ATF_IN_PAL_COMPAT_MODE)) {
+    for (j = 0; j < config->ues_size; j++) {
+      if (jedec->fuses[config->ues_address + j] == 1)
+        buffer[j / 8] |= (0x80 >> (j & 0x07));
+    }
+  }
+  // UES field is always written, even when not contained in JEDEC
+  if (minipro_write_jedec_row(handle, buffer, i, 0, config->ues_size))
+    return EXIT_FAILURE;
+
+  // Write architecture control word (ACW)
+  memset(buffer, 0, sizeof(buffer));
+  for (i = 0; i < config->acw_size; i++) {
+    if (jedec->fuses[config->acw_bits[i]] == 1)
+      buffer[i / 8] |= (0x80 >> (i & 0x07));
+  }
+  if (minipro_write_jedec_row(handle, buffer, config->acw_address,
+                              config->acw_address, config->acw_size))
+    return EXIT_FAILURE;
+
+  // Disable Power-Down by writing to specific power-down row
+  if(config->powerdown_row != 0) {
+    // only '0' bits shall be written
+    if(((handle->device->opts1 & LAST_JEDEC_BIT_IS_POWERDOWN_ENABLE)
+              && (jedec->fuses[jedec->QF - 1] == 0))
+          || (handle->device->opts1 & POWERDOWN_MODE_DISABLE)) {
+      memset(buffer, 0, sizeof(buffer));
+      if (minipro_write_jedec_row(handle, buffer, config->powerdown_row, 0, 1))
+        return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
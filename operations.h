@@ -0,0 +1,101 @@
+/*
+ * operations.h - Declarations for the memory and PLD operations of
+ *		the library.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef OPERATIONS_H_
+#define OPERATIONS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "jedec.h"
+#include "minipro.h"
+
+/*
+ * These functions work on caller supplied buffers and never print. The
+ * progress is reported through handle->progress_cb and every error
+ * through handle->error_cb (both optional). The transaction must have
+ * been started by the caller and is left to the caller to end, on
+ * errors too.
+ *
+ * The USB and programmer layers below (usb_*.c, tl866a.c, tl866iiplus.c)
+ * still print their own errors, such as USB transfer failures, to
+ * stderr. Only the errors of these functions go through error_cb.
+ */
+
+// PIC devices and the instruction word width of their code memory, 0 for
+// other devices
+int is_pic(minipro_handle_t *handle);
+size_t get_pic_word_width(minipro_handle_t *handle);
+
+// Mask of the significant bits of a memory's words, 0 for a plain byte
+// compare
+uint16_t get_compare_mask(minipro_handle_t *handle, uint8_t type);
+
+// Compare two buffers word by word through compare_mask. Returns the byte
+// offset of the first difference, or -1, and the words in c1 and c2.
+int compare_word_memory(uint16_t replacement_value, uint16_t compare_mask,
+                        uint8_t little_endian, uint8_t *s1, uint8_t *s2,
+                        size_t size1, size_t size2, uint16_t *c1,
+                        uint16_t *c2);
+
+// Called for every block transferred by the streaming operations
+typedef int (*minipro_block_cb)(void *ctx, uint8_t *block, size_t offset,
+                                size_t len);
+
+// Read [start, size) of a memory, passing every block to a callback.
+// start must be a multiple of the device read buffer size.
+int minipro_read_stream(minipro_handle_t *handle, uint8_t type, size_t start,
+                        size_t size, minipro_block_cb consume, void *ctx);
+
+// Same, reading only every stride-th block from start, and the last one
+int minipro_read_sampled(minipro_handle_t *handle, uint8_t type,
+                         size_t start, size_t size, size_t stride,
+                         minipro_block_cb consume, void *ctx);
+
+// Write [start, size) of a memory block by block. fill is called to
+// produce every block before it is written and the optional written
+// callback after. With check_status set, a verify error reported by the
+// programmer fails the write.
+int minipro_write_source(minipro_handle_t *handle, uint8_t type, size_t start,
+                         size_t size, uint8_t check_status,
+                         minipro_block_cb fill, minipro_block_cb written,
+                         void *ctx);
+
+// Write [start, size) of a memory from buffer. The optional callback is
+// invoked after every block written. With check_status set, a verify
+// error reported by the programmer fails the write.
+int minipro_write_stream(minipro_handle_t *handle, uint8_t *buffer,
+                         uint8_t type, size_t start, size_t size,
+                         uint8_t check_status, minipro_block_cb written,
+                         void *ctx);
+
+int minipro_read_memory(minipro_handle_t *handle, uint8_t type,
+                        uint8_t *buffer, size_t size);
+int minipro_write_memory(minipro_handle_t *handle, uint8_t type,
+                         uint8_t *buffer, size_t size, uint8_t check_status);
+
+// Compare a memory with buffer, through the compare mask of the memory.
+// *address is set to the first differing offset, or -1 if the contents
+// match.
+int minipro_verify_memory(minipro_handle_t *handle, uint8_t type,
+                          uint8_t *buffer, size_t size, int64_t *address);
+
+// Read and write the fuse map of a GAL/PLD device
+int minipro_read_pld(minipro_handle_t *handle, jedec_t *jedec);
+int minipro_write_pld(minipro_handle_t *handle, jedec_t *jedec);
+
+#endif /* OPERATIONS_H_ */
@@ -0,0 +1,184 @@
+/*
+ * pipeline.c - Block pipeline between two threads.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+
+static void event_init(pipeline_event_t *event) {
+  atomic_init(&event->waiting, 0);
+  pthread_mutex_init(&event->lock, NULL);
+  pthread_cond_init(&event->cond, NULL);
+}
+
+static void event_free(pipeline_event_t *event) {
+  pthread_mutex_destroy(&event->lock);
+  pthread_cond_destroy(&event->cond);
+}
+
+// Wake the threads sleeping on an event. The index or flag they wait on
+// must have been stored before.
+static void wake(pipeline_event_t *event) {
+  if (!atomic_load(&event->waiting)) return;
+  pthread_mutex_lock(&event->lock);
+  pthread_cond_broadcast(&event->cond);
+  pthread_mutex_unlock(&event->lock);
+}
+
+// Sleep until ready(arg) is true. The waiting flag is raised before ready()
+// is checked again, so a concurrent wake() can't be missed.
+static void wait_for(pipeline_event_t *event, int (*ready)(void *),
+                     void *arg) {
+  if (ready(arg)) return;
+  pthread_mutex_lock(&event->lock);
+  atomic_fetch_add(&event->waiting, 1);
+  while (!ready(arg)) pthread_cond_wait(&event->cond, &event->lock);
+  atomic_fetch_sub(&event->waiting, 1);
+  pthread_mutex_unlock(&event->lock);
+}
+
+int pipeline_init(pipeline_t *pipeline, size_t count, size_t slot_size) {
+  size_t i;
+
+  memset(pipeline, 0, sizeof(pipeline_t));
+  pipeline->slots = calloc(count, sizeof(pipeline_slot_t));
+  if (!pipeline->slots) return EXIT_FAILURE;
+  pipeline->count = count;
+  for (i = 0; i < count; i++) {
+    pipeline->slots[i].data = malloc(slot_size);
+    if (!pipeline->slots[i].data) {
+      pipeline_free(pipeline);
+      return EXIT_FAILURE;
+    }
+  }
+  atomic_init(&pipeline->head, 0);
+  atomic_init(&pipeline->tail, 0);
+  atomic_init(&pipeline->closed, 0);
+  atomic_init(&pipeline->aborted, 0);
+  event_init(&pipeline->event);
+  return EXIT_SUCCESS;
+}
+
+void pipeline_free(pipeline_t *pipeline) {
+  size_t i;
+  if (!pipeline->slots) return;
+  for (i = 0; i < pipeline->count; i++) free(pipeline->slots[i].data);
+  free(pipeline->slots);
+  pipeline->slots = NULL;
+  event_free(&pipeline->event);
+}
+
+static int can_acquire(void *arg) {
+  pipeline_t *pipeline = arg;
+  return atomic_load(&pipeline->aborted) ||
+         atomic_load(&pipeline->head) - atomic_load(&pipeline->tail) <
+             pipeline->count;
+}
+
+static int can_peek(void *arg) {
+  pipeline_t *pipeline = arg;
+  return atomic_load(&pipeline->aborted) || atomic_load(&pipeline->closed) ||
+         atomic_load(&pipeline->head) != atomic_load(&pipeline->tail);
+}
+
+pipeline_slot_t *pipeline_acquire(pipeline_t *pipeline) {
+  wait_for(&pipeline->event, can_acquire, pipeline);
+  if (atomic_load(&pipeline->aborted)) return NULL;
+  return &pipeline->slots[atomic_load(&pipeline->head) % pipeline->count];
+}
+
+void pipeline_publish(pipeline_t *pipeline) {
+  atomic_fetch_add(&pipeline->head, 1);
+  wake(&pipeline->event);
+}
+
+void pipeline_close(pipeline_t *pipeline) {
+  atomic_store(&pipeline->closed, 1);
+  wake(&pipeline->event);
+}
+
+pipeline_slot_t *pipeline_peek(pipeline_t *pipeline) {
+  wait_for(&pipeline->event, can_peek, pipeline);
+  if (atomic_load(&pipeline->aborted)) return NULL;
+  // The producer may have published a last slot before closing
+  if (atomic_load(&pipeline->head) == atomic_load(&pipeline->tail))
+    return NULL;
+  return &pipeline->slots[atomic_load(&pipeline->tail) % pipeline->count];
+}
+
+void pipeline_release(pipeline_t *pipeline) {
+  atomic_fetch_add(&pipeline->tail, 1);
+  wake(&pipeline->event);
+}
+
+void pipeline_abort(pipeline_t *pipeline) {
+  atomic_store(&pipeline->aborted, 1);
+  wake(&pipeline->event);
+}
+
+static void *run_stage(void *arg) {
+  pipeline_t *pipeline = arg;
+  pipeline->result = pipeline->stage(pipeline->ctx);
+  // A failed stage must not leave the other one waiting
+  if (pipeline->result) pipeline_abort(pipeline);
+  return NULL;
+}
+
+int pipeline_start(pipeline_t *pipeline, int (*stage)(void *), void *ctx) {
+  pipeline->stage = stage;
+  pipeline->ctx = ctx;
+  pipeline->result = EXIT_FAILURE;
+  return pthread_create(&pipeline->thread, NULL, run_stage, pipeline)
+             ? EXIT_FAILURE
+             : EXIT_SUCCESS;
+}
+
+int pipeline_join(pipeline_t *pipeline) {
+  pthread_join(pipeline->thread, NULL);
+  return pipeline->result;
+}
+
+void watermark_init(watermark_t *watermark, size_t value) {
+  atomic_init(&watermark->value, value);
+  atomic_init(&watermark->target, SIZE_MAX);
+  event_init(&watermark->event);
+}
+
+void watermark_free(watermark_t *watermark) { event_free(&watermark->event); }
+
+// Only wake the waiter once its target is reached, the value may be set
+// far more often than it is waited on
+void watermark_set(watermark_t *watermark, size_t value) {
+  atomic_store(&watermark->value, value);
+  if (value >= atomic_load(&watermark->target)) wake(&watermark->event);
+}
+
+typedef struct watermark_wait_s {
+  watermark_t *watermark;
+  size_t value;
+} watermark_wait_t;
+
+static int reached(void *arg) {
+  watermark_wait_t *wait = arg;
+  return atomic_load(&wait->watermark->value) >= wait->value;
+}
+
+void watermark_wait(watermark_t *watermark, size_t value) {
+  watermark_wait_t wait = {watermark, value};
+  atomic_store(&watermark->target, value);
+  wait_for(&watermark->event, reached, &wait);
+}
@@ -0,0 +1,100 @@
+/*
+ * pipeline.h - Declarations for the block pipeline between two threads.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of blocks in flight between the two stages
+#define PIPELINE_DEPTH 8
+
+/*
+ * A bounded single-producer/single-consumer ring of block buffers. The
+ * producer fills a slot taken with pipeline_acquire and hands it over with
+ * pipeline_publish; the consumer gets it with pipeline_peek and gives it
+ * back with pipeline_release. Passing a slot needs no lock, a stage only
+ * sleeps on the condition variable when the ring is empty or full.
+ */
+
+// Sleeping stages
+typedef struct pipeline_event_s {
+  atomic_int waiting;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} pipeline_event_t;
+
+typedef struct pipeline_slot_s {
+  uint8_t *data;
+  size_t offset;
+  size_t len;
+} pipeline_slot_t;
+
+typedef struct pipeline_s {
+  pipeline_slot_t *slots;
+  size_t count;
+  atomic_size_t head;  // slots published by the producer
+  atomic_size_t tail;  // slots released by the consumer
+  atomic_int closed;   // the producer has no more slots
+  atomic_int aborted;  // either stage failed
+  pipeline_event_t event;
+  pthread_t thread;
+  int (*stage)(void *);
+  void *ctx;
+  int result;
+} pipeline_t;
+
+int pipeline_init(pipeline_t *pipeline, size_t count, size_t slot_size);
+void pipeline_free(pipeline_t *pipeline);
+
+// Run stage(ctx) on a new thread, its result is returned by pipeline_join
+int pipeline_start(pipeline_t *pipeline, int (*stage)(void *), void *ctx);
+int pipeline_join(pipeline_t *pipeline);
+
+// Producer side. pipeline_acquire returns NULL if the pipeline was aborted.
+pipeline_slot_t *pipeline_acquire(pipeline_t *pipeline);
+void pipeline_publish(pipeline_t *pipeline);
+void pipeline_close(pipeline_t *pipeline);
+
+// Consumer side. pipeline_peek returns NULL once the pipeline is closed and
+// drained, or aborted.
+pipeline_slot_t *pipeline_peek(pipeline_t *pipeline);
+void pipeline_release(pipeline_t *pipeline);
+
+// Stop both stages, e.g. on error
+void pipeline_abort(pipeline_t *pipeline);
+
+/*
+ * A monotonic counter published by one thread, typically how much of a
+ * buffer is complete, that another thread can wait on.
+ */
+typedef struct watermark_s {
+  atomic_size_t value;
+  atomic_size_t target;  // value the waiter needs
+  pipeline_event_t event;
+} watermark_t;
+
+void watermark_init(watermark_t *watermark, size_t value);
+void watermark_free(watermark_t *watermark);
+void watermark_set(watermark_t *watermark, size_t value);
+// Wait until the watermark reaches value
+void watermark_wait(watermark_t *watermark, size_t value);
+
+#endif /* PIPELINE_H_ */
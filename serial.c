@@ -0,0 +1,251 @@
+/*
+ * serial.c - Serial numbers written into every chip.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "serial.h"
+
+// Load the values of a serial number list, one number per line.
+// Empty lines and lines starting with '#' are skipped.
+static int load_serial_list(serial_t *serial, const char *name) {
+  char line[256], *p_end;
+  uint64_t *tmp;
+  size_t capacity = 0;
+
+  FILE *file = fopen(name, "r");
+  if (!file) {
+    fprintf(stderr, "Could not open file %s for reading.\n", name);
+    perror("");
+    return EXIT_FAILURE;
+  }
+  while (fgets(line, sizeof(line), file)) {
+    char *p = line + strspn(line, " \t");
+    if (*p == '#' || *p == '\r' || *p == '\n' || !*p) continue;
+    if (serial->count == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      tmp = realloc(serial->list, capacity * sizeof(uint64_t));
+      if (!tmp) {
+        fclose(file);
+        fprintf(stderr, "Out of memory!\n");
+        return EXIT_FAILURE;
+      }
+      serial->list = tmp;
+    }
+    errno = 0;
+    serial->list[serial->count] = strtoull(p, &p_end, 0);
+    if (p_end == p || errno || !strchr(" \t\r\n", *p_end)) {
+      fclose(file);
+      fprintf(stderr, "%s:%llu: invalid serial number.\n", name,
+              (unsigned long long)serial->count + 1);
+      return EXIT_FAILURE;
+    }
+    serial->count++;
+  }
+  fclose(file);
+  if (!serial->count) {
+    fprintf(stderr, "No serial numbers in %s.\n", name);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+void free_serial(serial_t *serial) {
+  if (!serial) return;
+  free(serial->list);
+  free(serial->state);
+  free(serial);
+}
+
+serial_t *parse_serial(const char *spec) {
+  char key[64], value[1024], *p_end;
+  const char *p = spec;
+  int has_address = 0, n;
+
+  serial_t *serial = calloc(1, sizeof(serial_t));
+  if (!serial) {
+    fprintf(stderr, "Out of memory!\n");
+    return NULL;
+  }
+  serial->page = MP_CODE;
+  serial->size = 4;
+  serial->step = 1;
+
+  while (*p) {
+    if (sscanf(p, "%63[^=,]=%1023[^,]%n", key, value, &n) != 2) {
+      fprintf(stderr, "Invalid serial number option '%s'.\n", p);
+      free_serial(serial);
+      return NULL;
+    }
+    p += n;
+    if (*p == ',') p++;
+
+    errno = 0;
+    uint64_t v = strtoull(value, &p_end, 0);
+    int numeric = p_end != value && !*p_end && !errno;
+    int error = 0;
+    if (!strcasecmp(key, "address")) {
+      serial->address = v;
+      has_address = 1;
+      error = !numeric;
+    } else if (!strcasecmp(key, "size")) {
+      serial->size = v;
+      error = !numeric || !v || v > SERIAL_MAX_SIZE;
+    } else if (!strcasecmp(key, "start")) {
+      serial->value = v;
+      error = !numeric;
+    } else if (!strcasecmp(key, "step")) {
+      serial->step = v;
+      error = !numeric;
+    } else if (!strcasecmp(key, "checksum")) {
+      serial->checksum = 1;
+      serial->checksum_address = v;
+      error = !numeric;
+    } else if (!strcasecmp(key, "endian")) {
+      serial->big_endian = !strcasecmp(value, "big");
+      error = !serial->big_endian && strcasecmp(value, "little");
+    } else if (!strcasecmp(key, "page")) {
+      serial->page = !strcasecmp(value, "data") ? MP_DATA : MP_CODE;
+      error = serial->page == MP_CODE && strcasecmp(value, "code");
+    } else if (!strcasecmp(key, "list")) {
+      if (load_serial_list(serial, value)) {
+        free_serial(serial);
+        return NULL;
+      }
+    } else if (!strcasecmp(key, "state")) {
+      free(serial->state);
+      serial->state = strdup(value);
+      error = !serial->state;
+    } else
+      error = 1;
+    if (error) {
+      fprintf(stderr, "Invalid serial number option '%s=%s'.\n", key, value);
+      free_serial(serial);
+      return NULL;
+    }
+  }
+  if (!has_address) {
+    fprintf(stderr, "The serial number address is required.\n");
+    free_serial(serial);
+    return NULL;
+  }
+
+  // Continue from the last run
+  if (serial->state) {
+    FILE *file = fopen(serial->state, "r");
+    if (file) {
+      unsigned long long next;
+      int ok = fscanf(file, "%llu", &next) == 1;
+      fclose(file);
+      if (!ok) {
+        fprintf(stderr, "Invalid serial number state file %s.\n",
+                serial->state);
+        free_serial(serial);
+        return NULL;
+      }
+      if (serial->list)
+        serial->next = next;
+      else
+        serial->value = next;
+    }
+  }
+  return serial;
+}
+
+int serial_patch(serial_t *serial, patch_t *patch, size_t size) {
+  uint64_t value;
+  uint8_t sum = 0;
+  size_t i;
+
+  if (serial->list) {
+    if (serial->next >= serial->count) {
+      fprintf(stderr, "No serial numbers left.\n");
+      return EXIT_FAILURE;
+    }
+    value = serial->list[serial->next];
+  } else
+    value = serial->value;
+  if (serial->address + serial->size > size ||
+      (serial->checksum && serial->checksum_address >= size)) {
+    fprintf(stderr, "The serial number address is out of range.\n");
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < serial->size; i++) {
+    patch->address[i] = serial->address +
+                        (serial->big_endian ? serial->size - 1 - i : i);
+    patch->value[i] = (uint8_t)(value >> (i * 8));
+    sum += patch->value[i];
+  }
+  patch->count = serial->size;
+  // The serial number bytes and the checksum add up to zero
+  if (serial->checksum) {
+    patch->address[patch->count] = serial->checksum_address;
+    patch->value[patch->count++] = -sum;
+  }
+  fprintf(stderr, "Serial number: %llu (0x%llX)\n", (unsigned long long)value,
+          (unsigned long long)value);
+  return EXIT_SUCCESS;
+}
+
+// The state file is written under a temporary name, flushed to the disk
+// and renamed, so a crash leaves either the old or the new number and
+// never an empty file that would start the numbers over.
+int advance_serial(serial_t *serial) {
+  unsigned long long next;
+  if (serial->list)
+    next = ++serial->next;
+  else
+    next = serial->value += serial->step;
+  if (!serial->state) return EXIT_SUCCESS;
+
+  char tmp_name[strlen(serial->state) + 5];
+  sprintf(tmp_name, "%s.tmp", serial->state);
+
+  FILE *file = fopen(tmp_name, "w");
+  int error = !file || fprintf(file, "%llu\n", next) < 0 || fflush(file);
+#ifdef _WIN32
+  if (!error) error = _commit(_fileno(file));
+#else
+  if (!error) error = fsync(fileno(file));
+#endif
+  if ((file && fclose(file)) || error) {
+    fprintf(stderr, "Could not save the serial number state to %s.\n",
+            tmp_name);
+    if (file) remove(tmp_name);
+    return EXIT_FAILURE;
+  }
+#ifdef _WIN32
+  remove(serial->state);
+#endif
+  if (rename(tmp_name, serial->state)) {
+    fprintf(stderr, "Could not save the serial number state to %s.\n",
+            serial->state);
+    remove(tmp_name);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
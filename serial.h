@@ -0,0 +1,57 @@
+/*
+ * serial.h - Definitions and declarations for the serial numbers
+ *		written into every chip.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef SERIAL_H_
+#define SERIAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "image.h"
+
+// The serial number and its checksum byte make one patch
+#define SERIAL_MAX_SIZE (PATCH_MAX_SIZE - 1)
+
+// Serial number written into every chip, from a counter or a list
+typedef struct serial_s {
+  uint8_t page;       // MP_CODE or MP_DATA
+  size_t address;
+  uint8_t size;       // bytes
+  uint8_t big_endian;
+  uint8_t checksum;   // a checksum byte is written
+  size_t checksum_address;
+  uint64_t value;     // next counter value
+  uint64_t step;
+  uint64_t *list;     // values from a list file
+  size_t count;
+  size_t next;        // next list entry
+  char *state;        // file keeping the next value between runs
+} serial_t;
+
+// Parse a --serial specification: comma separated key=value pairs
+//   address=<n> (required), size=<1-8>, endian=little|big, page=code|data,
+//   start=<n>, step=<n> or list=<file>, checksum=<address>, state=<file>
+serial_t *parse_serial(const char *spec);
+void free_serial(serial_t *serial);
+
+// Build the patch of the next serial number for a size bytes image
+int serial_patch(serial_t *serial, patch_t *patch, size_t size);
+
+// Move to the next serial number once a chip was written
+int advance_serial(serial_t *serial);
+
+#endif /* SERIAL_H_ */
@@ -0,0 +1,108 @@
+/*
+ * split.c - Functions for ROM sets split over several chips.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include "split.h"
+
+split_t *parse_split(const char *spec) {
+  char key[64], value[64], *p_end;
+  const char *p = spec;
+  int n;
+
+  split_t *split = calloc(1, sizeof(split_t));
+  if (!split) {
+    fprintf(stderr, "Out of memory!\n");
+    return NULL;
+  }
+  split->lanes = 1;
+  split->width = 1;
+  split->banks = 1;
+  split->only = -1;
+
+  while (*p) {
+    if (sscanf(p, "%63[^=,]=%63[^,]%n", key, value, &n) != 2) {
+      fprintf(stderr, "Invalid split option '%s'.\n", p);
+      free(split);
+      return NULL;
+    }
+    p += n;
+    if (*p == ',') p++;
+
+    errno = 0;
+    unsigned long v = strtoul(value, &p_end, 0);
+    int error = p_end == value || *p_end || errno || !v || v > 64;
+    if (!strcasecmp(key, "lanes"))
+      split->lanes = v;
+    else if (!strcasecmp(key, "width"))
+      split->width = v;
+    else if (!strcasecmp(key, "banks"))
+      split->banks = v;
+    else if (!strcasecmp(key, "chip"))
+      split->only = v;
+    else
+      error = 1;
+    if (error) {
+      fprintf(stderr, "Invalid split option '%s=%s'.\n", key, value);
+      free(split);
+      return NULL;
+    }
+  }
+  split->count = split->lanes * split->banks;
+  if (split->only > (int)split->count) {
+    fprintf(stderr, "The set only has %u chips.\n", (unsigned)split->count);
+    free(split);
+    return NULL;
+  }
+  // Chips are numbered from 1 on the command line
+  if (split->only > 0) split->chip = --split->only;
+  return split;
+}
+
+int split_range(split_t *split, size_t chip_size, size_t offset, size_t len,
+                size_t *start, size_t *span) {
+  if (!len || offset > chip_size || len > chip_size - offset) {
+    fprintf(stderr, "Chip range 0x%llx-0x%llx is past the chip size.\n",
+            (unsigned long long)offset, (unsigned long long)(offset + len));
+    return EXIT_FAILURE;
+  }
+  size_t lanes = split->lanes, width = split->width;
+  size_t bank = split->chip / lanes;
+  size_t first = offset / width, last = (offset + len - 1) / width;
+  *start = bank * chip_size * lanes + first * lanes * width;
+  *span = (last - first + 1) * lanes * width;
+  return EXIT_SUCCESS;
+}
+
+void split_gather(split_t *split, const uint8_t *set, uint8_t *block,
+                  size_t offset, size_t len) {
+  size_t lanes = split->lanes, width = split->width;
+  size_t lane = split->chip % lanes, first = offset / width;
+  size_t i;
+
+  if (width == 1) {
+    const uint8_t *p = set + lane;
+    for (i = 0; i < len; i++) block[i] = p[i * lanes];
+  } else {
+    for (i = 0; i < len; i++) {
+      size_t unit = (offset + i) / width - first;
+      block[i] = set[(unit * lanes + lane) * width + (offset + i) % width];
+    }
+  }
+}
@@ -0,0 +1,52 @@
+/*
+ * split.h - Definitions and declarations for ROM sets split over
+ *		several chips.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef SPLIT_H_
+#define SPLIT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A ROM set: the image is split over lanes * banks chips. Chip n holds
+// lane n % lanes of bank n / lanes; a lane takes width bytes out of every
+// lanes * width, a bank is one chip's worth of lanes.
+typedef struct split_s {
+  size_t lanes;
+  size_t width;
+  size_t banks;
+  size_t count;   // chips in the set
+  size_t chip;    // chip being written or verified
+  int only;       // single chip selected with chip=, -1 for all
+} split_t;
+
+// Parse a --split specification: comma separated key=value pairs
+//   lanes=<n>, width=<bytes per lane>, banks=<n>, chip=<1..lanes*banks>
+split_t *parse_split(const char *spec);
+
+// The range [*start, *start + *span) of the set image holding
+// [offset, offset + len) of the current chip, which has chip_size bytes.
+// Fails for a range past the end of the chip.
+int split_range(split_t *split, size_t chip_size, size_t offset, size_t len,
+                size_t *start, size_t *span);
+
+// Pick [offset, offset + len) of the current chip out of the set data of
+// split_range
+void split_gather(split_t *split, const uint8_t *set, uint8_t *block,
+                  size_t offset, size_t len);
+
+#endif /* SPLIT_H_ */
@@ -184,9 +184,14 @@ static int write_record(FILE *file, record_t *record) {
   return EXIT_SUCCESS;
 }
 
-// Read a Motorola S-Record file
-int read_srec_file(uint8_t *buffer, uint8_t *data, size_t *size) {
+// Read a Motorola S-Record file, offset is added to the record addresses.
+// The optional progress callback gets the address and length of every
+// data record before it is copied.
+int read_srec_stream(uint8_t *buffer, uint8_t *data, size_t *size,
+                     int64_t offset, void (*progress)(void *, size_t, size_t),
+                     void *ctx) {
   uint32_t line = 0;
+  int64_t address;
   record_t rec;
   size_t s0 = 0;
   size_t chip_size = *size;
@@ -221,13 +226,19 @@ int read_srec_file(uint8_t *buffer, uint8_t *data, size_t *size) {
           case S1:
           case S2:
           case S3:
+            address = (int64_t)rec.address + offset;
+            if (address < 0) {
+              fprintf(stderr, "Error on line %u: negative address.\n", line);
+              return EXIT_FAILURE;
+            }
+            if (progress) progress(ctx, address, rec.count);
             // If file data size is bigger than chip size
             // update the new size
-            if (chip_size >= rec.address + rec.count)
+            if (chip_size >= address + rec.count)
               // copy record data
-              memcpy(&(data[rec.address]), rec.data, rec.count);
+              memcpy(&(data[address]), rec.data, rec.count);
             else
-              *size = (rec.address + rec.count);
+              *size = (address + rec.count);
             break;
           case S5:
           case S6:
@@ -250,43 +261,105 @@ int read_srec_file(uint8_t *buffer, uint8_t *data, size_t *size) {
   return SREC_FORMAT;
 }
 
-// Write an S-Record file
-int write_srec_file(FILE *file, uint8_t *data, size_t size) {
-  record_t rec;
-  uint32_t address = 0;
-  size_t len;
-  uint8_t type;
+int read_srec_file(uint8_t *buffer, uint8_t *data, size_t *size) {
+  return read_srec_stream(buffer, data, size, 0, NULL, NULL);
+}
 
+// Decode count hex digits
+static int hex_field(uint8_t *field, size_t count, uint32_t *value) {
+  size_t i;
+  *value = 0;
+  for (i = 0; i < count; i++) {
+    if (hex(field[i]) > 0x0F) return EXIT_FAILURE;
+    *value = (*value << 4) | hex(field[i]);
+  }
+  return EXIT_SUCCESS;
+}
+
+// Scan the record headers of an S-Record file without decoding the data,
+// updating size like read_srec_file. Returns 1 if the data records are
+// sorted by address, 0 if not and -1 if this doesn't look like an S-Record
+// file.
+int scan_srec_file(uint8_t *buffer, size_t *size, int64_t offset) {
+  uint32_t type, count, address, last = 0;
+  size_t digits, chip_size = *size;
+  int sorted = 1;
+
+  while ((buffer = (uint8_t *)strchr((char *)buffer, 'S'))) {
+    if (hex_field(buffer + 1, 1, &type) || hex_field(buffer + 2, 2, &count))
+      return -1;
+    if (type >= S1 && type <= S3) {
+      digits = (type + 1) * 2;
+      if (hex_field(buffer + 4, digits, &address)) return -1;
+      count -= digits / 2 + 1;
+      if (address < last) sorted = 0;
+      last = address;
+      if ((int64_t)chip_size < address + offset + count)
+        *size = address + offset + count;
+    }
+    buffer++;
+  }
+  return sorted;
+}
+
+// Start an S-Record file of an image placed at base
+void srec_writer_init(srec_writer_t *writer, FILE *file, uint32_t base,
+                      size_t row_size) {
+  record_t rec;
   char *header = "Written by Minipro open source software";
+
+  writer->file = file;
+  writer->base = base;
+  writer->row_size = row_size;
+  writer->records = 0;
   memcpy(rec.data, header, strlen(header));
   rec.type = S0;
   rec.count = strlen(header);
   rec.address = 0x00;
   write_record(file, &rec);
-  size_t line = 0;
+}
+
+// Write the records of size bytes at offset in the image. Parts of the
+// image may be left out, but the data must be written in address order.
+int srec_writer_data(srec_writer_t *writer, uint8_t *data, size_t offset,
+                     size_t size) {
+  record_t rec;
+  uint32_t address = writer->base + offset;
+  size_t len;
 
   while (size) {
-    if (address < 65536)
-      type = S1;
-    else if (address < 16777216)
-      type = S2;
+    len = size > writer->row_size ? writer->row_size : size;
+    if (address + len <= 65536)
+      rec.type = S1;
+    else if (address + len <= 16777216)
+      rec.type = S2;
     else
-      type = S3;
-    len = (size > ROW_SIZE ? ROW_SIZE : size);
-    rec.type = type;
+      rec.type = S3;
     rec.count = len;
     rec.address = address;
     memcpy(rec.data, data, len);
-    write_record(file, &rec);
-    data += ROW_SIZE;
+    write_record(writer->file, &rec);
+    writer->records++;
+    data += len;
     size -= len;
-    address += ROW_SIZE;
-    line++;
+    address += len;
   }
-  // Write record count
-  rec.type = (line < 65536 ? S5 : S6);
+  return EXIT_SUCCESS;
+}
+
+// Write the record count
+int srec_writer_end(srec_writer_t *writer) {
+  record_t rec;
+  rec.type = writer->records < 65536 ? S5 : S6;
   rec.count = 0x00;
-  rec.address = line;
-  write_record(file, &rec);
+  rec.address = writer->records;
+  write_record(writer->file, &rec);
   return EXIT_SUCCESS;
 }
+
+int write_srec_file(FILE *file, uint8_t *data, size_t size) {
+  srec_writer_t writer;
+  srec_writer_init(&writer, file, 0, ROW_SIZE);
+  srec_writer_data(&writer, data, 0, size);
+  return srec_writer_end(&writer);
+}
@@ -24,7 +24,26 @@
 #define SREC_FORMAT 0
 #define NOT_SREC -1
 
+#define SREC_MAX_ROW 250
+
+// Writes an S-Record file block by block
+typedef struct srec_writer_s {
+  FILE *file;
+  uint32_t base;    // address of the first image byte in the file
+  size_t row_size;  // data bytes per record
+  size_t records;   // data records written
+} srec_writer_t;
+
 int read_srec_file(uint8_t *buffer, uint8_t *data, size_t *size);
+int read_srec_stream(uint8_t *buffer, uint8_t *data, size_t *size,
+                     int64_t offset, void (*progress)(void *, size_t, size_t),
+                     void *ctx);
+int scan_srec_file(uint8_t *buffer, size_t *size, int64_t offset);
 int write_srec_file(FILE *file, uint8_t *data, size_t size);
+void srec_writer_init(srec_writer_t *writer, FILE *file, uint32_t base,
+                      size_t row_size);
+int srec_writer_data(srec_writer_t *writer, uint8_t *data, size_t offset,
+                     size_t size);
+int srec_writer_end(srec_writer_t *writer);
 
 #endif
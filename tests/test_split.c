@@ -0,0 +1,103 @@
+/*
+ * test_split.c - Tests of the ROM set lane and bank mapping.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "split.h"
+
+#define CHIP_SIZE 4096
+#define BLOCK_SIZE 64
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                \
+  do {                                  \
+    if (!(cond)) {                      \
+      fprintf(stderr, __VA_ARGS__);     \
+      fprintf(stderr, "\n");            \
+      failures++;                       \
+    }                                   \
+  } while (0)
+
+// Read a whole chip of the set block by block, like the verify does, and
+// check it against the byte the set image holds for every chip address.
+static void check_set(const char *spec, size_t chip_size) {
+  split_t *split = parse_split(spec);
+  CHECK(split, "%s: not parsed", spec);
+  if (!split) return;
+
+  size_t set_size = chip_size * split->count, i;
+  uint8_t *set = malloc(set_size);
+  uint8_t block[BLOCK_SIZE];
+  for (i = 0; i < set_size; i++) set[i] = (uint8_t)(i * 7 + i / 251);
+
+  for (split->chip = 0; split->chip < split->count; split->chip++) {
+    size_t lane = split->chip % split->lanes;
+    size_t bank = split->chip / split->lanes;
+    size_t offset, start, span;
+    for (offset = 0; offset < chip_size; offset += BLOCK_SIZE) {
+      int ret = split_range(split, chip_size, offset, BLOCK_SIZE, &start,
+                            &span);
+      CHECK(!ret, "%s chip %zu: block 0x%zx rejected", spec, split->chip,
+            offset);
+      CHECK(start + span <= set_size,
+            "%s chip %zu: block 0x%zx reads past the set image", spec,
+            split->chip, offset);
+      if (ret || start + span > set_size) continue;
+      split_gather(split, set + start, block, offset, BLOCK_SIZE);
+      for (i = 0; i < BLOCK_SIZE; i++) {
+        size_t address = offset + i;
+        size_t unit = address / split->width;
+        size_t expected = bank * chip_size * split->lanes +
+                          (unit * split->lanes + lane) * split->width +
+                          address % split->width;
+        CHECK(block[i] == set[expected],
+              "%s chip %zu: byte 0x%zx is 0x%02x, expected 0x%02x", spec,
+              split->chip, address, block[i], set[expected]);
+      }
+    }
+    // The chip ends at its own size, not at the size of the set
+    CHECK(split_range(split, chip_size, chip_size, BLOCK_SIZE, &start,
+                      &span),
+          "%s chip %zu: block past the chip accepted", spec, split->chip);
+    CHECK(split_range(split, chip_size, chip_size - BLOCK_SIZE / 2,
+                      BLOCK_SIZE, &start, &span),
+          "%s chip %zu: block across the chip end accepted", spec,
+          split->chip);
+  }
+  free(set);
+  free(split);
+}
+
+int main(void) {
+  check_set("lanes=2", CHIP_SIZE);
+  check_set("lanes=2,width=2", CHIP_SIZE);
+  check_set("lanes=4", CHIP_SIZE);
+  check_set("lanes=2,banks=2", CHIP_SIZE);
+  check_set("lanes=2,width=2,banks=3", CHIP_SIZE);
+
+  CHECK(!parse_split("lanes=0"), "lanes=0 accepted");
+  CHECK(!parse_split("lanes=2,chip=3"), "chip=3 of 2 accepted");
+  CHECK(!parse_split("depth=2"), "unknown option accepted");
+
+  if (failures) {
+    fprintf(stderr, "test_split: %d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("test_split: OK\n");
+  return EXIT_SUCCESS;
+}
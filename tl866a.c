@@ -460,10 +460,9 @@ int tl866a_read_jedec_row(minipro_handle_t *handle, uint8_t *buffer,
 int tl866a_unlock_tsop48(minipro_handle_t *handle, uint8_t *status) {
   uint8_t msg[64];
   memset(msg, 0, sizeof(msg));
-  srand(time(NULL));
   uint16_t i, crc = 0;
   for (i = 7; i < 15; i++) {
-    msg[i] = (uint8_t)rand();
+    msg[i] = minipro_random(handle);
     // Calculate the crc16
     crc = (crc >> 8) | (crc << 8);
     crc ^= msg[i];
@@ -752,11 +751,11 @@ static const uint8_t cs_xortable[] = {
     0xEB, 0xB1, 0xEE, 0x79};
 
 // encrypt a block of 80 bytes
-static void encrypt_block(uint8_t *data, const uint8_t *xortable,
-                          uint8_t index) {
+static void encrypt_block(minipro_handle_t *handle, uint8_t *data,
+                          const uint8_t *xortable, uint8_t index) {
   uint32_t i;
   for (i = 0; i < 16; i++) {
-    data[i + 64] = (uint8_t)rand();
+    data[i + 64] = minipro_random(handle);
   }
 
   for (i = 0; i < TL866A_FIRMWARE_BLOCK_SIZE / 2; i += 4) {
@@ -795,8 +794,8 @@ static void decrypt_block(uint8_t *data, const uint8_t *xortable,
 }
 
 // Encrypt firmware
-static void encrypt_firmware(const uint8_t *data_in, uint8_t *data_out,
-                             uint8_t key, uint8_t index) {
+static void encrypt_firmware(minipro_handle_t *handle, const uint8_t *data_in,
+                             uint8_t *data_out, uint8_t key, uint8_t index) {
   uint32_t i;
   uint8_t data[TL866A_FIRMWARE_BLOCK_SIZE];
   const uint8_t *xortable = (key == MP_TL866A ? a_xortable : cs_xortable);
@@ -804,7 +803,7 @@ static void encrypt_firmware(const uint8_t *data_in, uint8_t *data_out,
   for (i = 0; i < TL866A_UNENC_FIRMWARE_SIZE;
        i += TL866A_FIRMWARE_BLOCK_SIZE - 16) {
     memcpy(data, data_in + i, TL866A_FIRMWARE_BLOCK_SIZE - 16);
-    encrypt_block(data, xortable, index);
+    encrypt_block(handle, data, xortable, index);
     memcpy(data_out, data, TL866A_FIRMWARE_BLOCK_SIZE);
     data_out += TL866A_FIRMWARE_BLOCK_SIZE;
     index += 4;
@@ -876,9 +875,9 @@ int tl866a_firmware_update(minipro_handle_t *handle, const char *firmware) {
   }
 
   if ((update_dat.a_crc32 !=
-       ~crc32(a_firmware, sizeof(a_firmware), 0xFFFFFFFF)) ||
+       ~minipro_crc32(a_firmware, sizeof(a_firmware), 0xFFFFFFFF)) ||
       (update_dat.cs_crc32 !=
-       ~crc32(cs_firmware, sizeof(cs_firmware), 0xFFFFFFFF))) {
+       ~minipro_crc32(cs_firmware, sizeof(cs_firmware), 0xFFFFFFFF))) {
     fprintf(stderr, "%s crc error!\n", firmware);
     return EXIT_FAILURE;
   }
@@ -945,7 +944,7 @@ int tl866a_firmware_update(minipro_handle_t *handle, const char *firmware) {
      Second step: encrypt back the firmware with the true device version key.
      This way we can have CS devices flashed with A firmware and vice versa.
      */
-    encrypt_firmware(data,
+    encrypt_firmware(handle, data,
                      handle->version == MP_TL866A ? a_firmware : cs_firmware,
                      handle->version,
                      handle->version == MP_TL866A ? update_dat.a_erase
@@ -456,9 +456,8 @@ int tl866iiplus_unlock_tsop48(minipro_handle_t *handle, uint8_t *status) {
 
   msg_init(handle, TL866IIPLUS_UNLOCK_TSOP48, msg, sizeof(msg));
 
-  srand(time(NULL));
   for (i = 8; i < 16; i++) {
-    msg[i] = (uint8_t)rand();
+    msg[i] = minipro_random(handle);
     // Calculate the crc16
     crc = (crc >> 8) | (crc << 8);
     crc ^= msg[i];
@@ -583,12 +582,12 @@ int tl866iiplus_firmware_update(minipro_handle_t *handle,
   // Note the order in which the crc is calculated!
   // First the data blocks crc
   if (blocks > 0) {
-    crc = crc32(update_dat + 1036, blocks * 272, crc);
+    crc = minipro_crc32(update_dat + 1036, blocks * 272, crc);
   }
   // Second the last block crc
-  crc = crc32(update_dat + blocks * 272 + 1036, 2064, crc);
+  crc = minipro_crc32(update_dat + blocks * 272 + 1036, 2064, crc);
   // And last the xortable+blocks_count crc
-  crc = crc32(update_dat + 8, 1028, crc);
+  crc = minipro_crc32(update_dat + 8, 1028, crc);
   // The computed CRC32 must match the File CRC from the offset 4
   if (~crc != load_int(update_dat + 4, 4, MP_LITTLE_ENDIAN)) {
     fprintf(stderr, "%s file CRC error!\n", firmware);
@@ -623,7 +622,7 @@ int tl866iiplus_firmware_update(minipro_handle_t *handle,
       xorptr += 6;
     }
     // After deobfuscating the address calculate the block crc and compare
-    if (crc32(update_dat + ptr + 4, 268, 0) !=
+    if (minipro_crc32(update_dat + ptr + 4, 268, 0) !=
         load_int(update_dat + ptr, 4, MP_LITTLE_ENDIAN)) {
       fprintf(stderr, "%s file CRC error!\n", firmware);
       free(update_dat);
@@ -645,7 +644,7 @@ int tl866iiplus_firmware_update(minipro_handle_t *handle,
     xorptr += 4;
   }
   // After deobfuscating the address calculate the block crc and compare
-  if (crc32(update_dat + ptr + 4, 2060, 0) !=
+  if (minipro_crc32(update_dat + ptr + 4, 2060, 0) !=
       load_int(update_dat + ptr, 4, MP_LITTLE_ENDIAN)) {
     fprintf(stderr, "%s file CRC error!\n", firmware);
     free(update_dat);
@@ -840,12 +839,10 @@ int tl866iiplus_firmware_update(minipro_handle_t *handle,
   return EXIT_SUCCESS;
 }
 
-int tl866iiplus_pin_test(minipro_handle_t *handle) {
-  uint8_t msg[48], pins[40];
-
-  // Get the chip pin mask for testing
-  pin_map_t *map = get_pin_map(handle->device->opts8 & 0xFF);
-  if (!map) return EXIT_FAILURE;
+// Read which ZIF socket pins have contact with the chip
+static int read_pin_contacts(minipro_handle_t *handle, pin_map_t *map,
+                             uint8_t *pins) {
+  uint8_t msg[48];
 
   // Set the desired output pins
   msg[0] = TL866IIPLUS_SET_DIR;
@@ -921,6 +918,16 @@ int tl866iiplus_pin_test(minipro_handle_t *handle) {
   // End of transaction
   msg[0] = TL866IIPLUS_END_TRANS;
   if (msg_send(handle->usb_handle, msg, sizeof(msg))) return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
+
+int tl866iiplus_pin_test(minipro_handle_t *handle) {
+  uint8_t pins[40];
+
+  // Get the chip pin mask for testing
+  pin_map_t *map = get_pin_map(handle->device->opts8 & 0xFF);
+  if (!map) return EXIT_FAILURE;
+  if (read_pin_contacts(handle, map, pins)) return EXIT_FAILURE;
 
   // Now check for bad pin contact
   int ret = EXIT_SUCCESS;
@@ -936,6 +943,34 @@ int tl866iiplus_pin_test(minipro_handle_t *handle) {
   return ret;
 }
 
+// Report whether a chip is seated, using the same pin readout as the pin test
+int tl866iiplus_chip_present(minipro_handle_t *handle, uint8_t *status) {
+  uint8_t pins[40];
+  uint32_t i, total = 0, contacts = 0;
+
+  pin_map_t *map = get_pin_map(handle->device->opts8 & 0xFF);
+  if (!map) return EXIT_FAILURE;
+  if (read_pin_contacts(handle, map, pins)) return EXIT_FAILURE;
+
+  for (i = 0; i < 40; i++) {
+    if (map->mask[i]) {
+      total++;
+      if (pins[i]) contacts++;
+    }
+  }
+  if (!total) {
+    fprintf(stderr, "No pin map for %s.\n", handle->device->name);
+    return EXIT_FAILURE;
+  }
+  if (!contacts)
+    *status = MP_CHIP_ABSENT;
+  else if (contacts < total)
+    *status = MP_CHIP_PARTIAL;
+  else
+    *status = MP_CHIP_PRESENT;
+  return EXIT_SUCCESS;
+}
+
 static int init_zif(minipro_handle_t *handle, uint8_t pullup) {
   uint8_t msg[48];
   // Reset pin drivers state
@@ -0,0 +1,126 @@
+/*
+ * transform.c - Byte and bit order transforms of image blocks.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <string.h>
+#include "transform.h"
+
+// 16 bytes at a time with SSSE3 (checked at run time) or NEON shuffles,
+// the scalar code does the rest of a block and other CPUs.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_SSSE3
+#include <tmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define TRANSFORM_NEON
+#include <arm_neon.h>
+#endif
+
+// Byte order of the swaps within a 32-bit group: byte i of the output is
+// byte i ^ swap_xor() of the input
+static int swap_xor(int transform) {
+  return (transform & TRANSFORM_SWAP16 ? 1 : 0) ^
+         (transform & TRANSFORM_SWAP32 ? 3 : 0);
+}
+
+static uint8_t reverse_bits(uint8_t b) {
+  b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+  b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+  b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+  return b;
+}
+
+static void transform_scalar(uint8_t *block, size_t len, int transform) {
+  int x = swap_xor(transform);
+  size_t unit = transform & TRANSFORM_SWAP32   ? 4
+                : transform & TRANSFORM_SWAP16 ? 2
+                                               : 1;
+  size_t i, j;
+  uint8_t word[4];
+
+  len -= len % unit;
+  for (i = 0; i < len; i += unit) {
+    memcpy(word, block + i, unit);
+    for (j = 0; j < unit; j++) {
+      uint8_t b = word[j ^ x];
+      block[i + j] =
+          transform & TRANSFORM_BITREVERSE ? reverse_bits(b) : b;
+    }
+  }
+}
+
+#ifdef TRANSFORM_SSSE3
+__attribute__((target("ssse3"))) static size_t transform_ssse3(
+    uint8_t *block, size_t len, int transform) {
+  int x = swap_xor(transform), i;
+  uint8_t order[16], rev[16];
+  size_t done;
+
+  for (i = 0; i < 16; i++) {
+    order[i] = (i & ~3) | ((i & 3) ^ x);
+    rev[i] = reverse_bits(i) >> 4;
+  }
+  __m128i shuffle = _mm_loadu_si128((const __m128i *)order);
+  __m128i rev_low = _mm_loadu_si128((const __m128i *)rev);
+  __m128i rev_high = _mm_slli_epi16(rev_low, 4);
+  __m128i nibble = _mm_set1_epi8(0x0F);
+
+  for (done = 0; done + 16 <= len; done += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(block + done));
+    if (x) v = _mm_shuffle_epi8(v, shuffle);
+    if (transform & TRANSFORM_BITREVERSE) {
+      // The reversed low nibble becomes the high one and vice versa
+      __m128i low = _mm_and_si128(v, nibble);
+      __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+      v = _mm_or_si128(_mm_shuffle_epi8(rev_high, low),
+                       _mm_shuffle_epi8(rev_low, high));
+    }
+    _mm_storeu_si128((__m128i *)(block + done), v);
+  }
+  return done;
+}
+#endif
+
+#ifdef TRANSFORM_NEON
+static size_t transform_neon(uint8_t *block, size_t len, int transform) {
+  int x = swap_xor(transform), i;
+  uint8_t order[16];
+  size_t done;
+
+  for (i = 0; i < 16; i++) order[i] = (i & ~3) | ((i & 3) ^ x);
+  uint8x16_t shuffle = vld1q_u8(order);
+
+  for (done = 0; done + 16 <= len; done += 16) {
+    uint8x16_t v = vld1q_u8(block + done);
+    if (x) v = vqtbl1q_u8(v, shuffle);
+    if (transform & TRANSFORM_BITREVERSE) v = vrbitq_u8(v);
+    vst1q_u8(block + done, v);
+  }
+  return done;
+}
+#endif
+
+void transform_block(uint8_t *block, size_t len, int transform) {
+  size_t done = 0;
+  if (!transform) return;
+#ifdef TRANSFORM_SSSE3
+  if (__builtin_cpu_supports("ssse3"))
+    done = transform_ssse3(block, len, transform);
+#endif
+#ifdef TRANSFORM_NEON
+  done = transform_neon(block, len, transform);
+#endif
+  transform_scalar(block + done, len - done, transform);
+}
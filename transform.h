@@ -0,0 +1,38 @@
+/*
+ * transform.h - Declarations for the byte and bit order transforms.
+ *
+ * This file is a part of Minipro.
+ *
+ * Minipro is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Minipro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef TRANSFORM_H_
+#define TRANSFORM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Transforms between the file and the chip, they can be combined.
+// SWAP32 and SWAP16 together swap the 16-bit halves of every 32-bit word.
+enum {
+  TRANSFORM_SWAP16 = 0x01,
+  TRANSFORM_SWAP32 = 0x02,
+  TRANSFORM_BITREVERSE = 0x04
+};
+
+// Transform a block in place. Every transform is its own inverse, so the
+// same call converts file data for the chip and chip data for the file.
+// The block must start on a word boundary; a trailing partial word is
+// left as is.
+void transform_block(uint8_t *block, size_t len, int transform);
+
+#endif /* TRANSFORM_H_ */
@@ -18,11 +18,18 @@
 #ifndef USB_H_
 #define USB_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
-void *usb_open(uint8_t verbose);
+// Open the index-th connected programmer, the TL866A/CS ones before the
+// TL866II+ ones. NULL if there is none or it can't be opened, e.g. when
+// it is in use.
+void *usb_open(int index, uint8_t verbose);
 int usb_close(void *usb_handle);
 int minipro_get_devices_count(uint8_t version);
+// Where an open programmer is connected: "<bus>:<address>" with libusb,
+// the device path on Windows
+void usb_location(void *usb_handle, char *location, size_t size);
 
 int msg_send(void *handle, uint8_t *buffer, size_t size);
 int msg_recv(void *handle, uint8_t *buffer, size_t size);
@@ -30,71 +30,120 @@
 #define MP_USBTIMEOUT 5000
 #define MP_USB_READ_TIMEOUT 360000
 
+// Each open device gets its own libusb context so that several
+// programmers can be driven from different threads.
+typedef struct usb_device_s {
+  libusb_context *context;
+  libusb_device_handle *handle;
+  uint8_t bus;
+  uint8_t address;
+} usb_device_t;
+
+// Find the index-th programmer of a device list, TL866A/CS ones first
+static libusb_device *find_programmer(libusb_device **devs, ssize_t count,
+                                      int index) {
+  static const uint16_t ids[][2] = {{MP_TL866_VID, MP_TL866_PID},
+                                    {MP_TL866II_VID, MP_TL866II_PID}};
+  size_t id;
+  ssize_t i;
+
+  for (id = 0; id < sizeof(ids) / sizeof(ids[0]); id++) {
+    for (i = 0; i < count; i++) {
+      struct libusb_device_descriptor desc;
+      if (libusb_get_device_descriptor(devs[i], &desc) < 0) continue;
+      if (desc.idVendor == ids[id][0] && desc.idProduct == ids[id][1] &&
+          !index--)
+        return devs[i];
+    }
+  }
+  return NULL;
+}
+
 // Open usb device
-void *usb_open(uint8_t verbose) {
-  int ret = libusb_init(NULL);
+void *usb_open(int index, uint8_t verbose) {
+  usb_device_t *device = malloc(sizeof(usb_device_t));
+  if (!device) {
+    if(verbose)
+    	fprintf(stderr, "Out of memory\n");
+    return NULL;
+  }
+
+  int ret = libusb_init(&device->context);
   if (ret < 0) {
     if(verbose)
     	fprintf(stderr, "Error initializing libusb: %s\n", libusb_error_name(ret));
+    free(device);
     return NULL;
   }
 
-  void *usb_handle =
-      libusb_open_device_with_vid_pid(NULL, MP_TL866_VID, MP_TL866_PID);
-  if (usb_handle == NULL) {
-    // We didn't match the vid / pid of the "original" TL866 - so try the new
-    // TL866II+
-    usb_handle =
-        libusb_open_device_with_vid_pid(NULL, MP_TL866II_VID, MP_TL866II_PID);
-
-    // If we don't get that either report error in connecting
-    if (usb_handle == NULL) {
-      libusb_exit(NULL);
-      if(verbose)
-    	  fprintf(stderr, "No programmer found.\n");
-      return NULL;
-    }
+  libusb_device **devs;
+  ssize_t count = libusb_get_device_list(device->context, &devs);
+  libusb_device *dev = count < 0 ? NULL : find_programmer(devs, count, index);
+  device->handle = NULL;
+  if (dev) {
+    device->bus = libusb_get_bus_number(dev);
+    device->address = libusb_get_device_address(dev);
+    if (libusb_open(dev, &device->handle)) device->handle = NULL;
+  }
+  if (count >= 0) libusb_free_device_list(devs, 1);
+
+  // If we don't get one report error in connecting
+  if (device->handle == NULL) {
+    libusb_exit(device->context);
+    free(device);
+    if(verbose)
+  	  fprintf(stderr, "No programmer found.\n");
+    return NULL;
   }
 
-  ret = libusb_claim_interface(usb_handle, 0);
+  ret = libusb_claim_interface(device->handle, 0);
   if (ret != 0) {
     if(verbose)
     	fprintf(stderr, "\nIO error: claim_interface: %s\n",
             libusb_error_name(ret));
-    libusb_close(usb_handle);
-    libusb_exit(NULL);
+    libusb_close(device->handle);
+    libusb_exit(device->context);
+    free(device);
     return NULL;
   }
-  return usb_handle;
+  return device;
+}
+
+void usb_location(void *usb_handle, char *location, size_t size) {
+  usb_device_t *device = usb_handle;
+  snprintf(location, size, "%u:%u", device->bus, device->address);
 }
 
 // Close usb device
 int usb_close(void *usb_handle) {
+  usb_device_t *device = usb_handle;
   int ret = EXIT_SUCCESS;
-  ret = libusb_release_interface(usb_handle, 0);
+  ret = libusb_release_interface(device->handle, 0);
   if (ret != 0 && ret != LIBUSB_ERROR_NO_DEVICE) {
     fprintf(stderr, "\nIO error: release_interface: %s\n",
             libusb_error_name(ret));
     ret = EXIT_FAILURE;
   }
-  libusb_close(usb_handle);
-  libusb_exit(NULL);
+  libusb_close(device->handle);
+  libusb_exit(device->context);
+  free(device);
   return ret;
 }
 
 // Get no. of devices connected
 int minipro_get_devices_count(uint8_t version) {
+  libusb_context *context;
   libusb_device **devs;
   int devices = 0;
 
   uint16_t PID = version == MP_TL866IIPLUS ? MP_TL866II_PID : MP_TL866_PID;
   uint16_t VID = version == MP_TL866IIPLUS ? MP_TL866II_VID : MP_TL866_VID;
 
-  if (libusb_init(NULL) < 0) return 0;
+  if (libusb_init(&context) < 0) return 0;
 
-  int count = libusb_get_device_list(NULL, &devs);
+  int count = libusb_get_device_list(context, &devs);
   if (count < 0) {
-    libusb_exit(NULL);
+    libusb_exit(context);
     return 0;
   }
 
@@ -103,7 +152,7 @@ int minipro_get_devices_count(uint8_t version) {
     int ret = libusb_get_device_descriptor(devs[i], &desc);
     if (ret < 0) {
       libusb_free_device_list(devs, 1);
-      libusb_exit(NULL);
+      libusb_exit(context);
       return 0;
     }
     if (desc.idProduct == PID && desc.idVendor == VID) {
@@ -111,7 +160,7 @@ int minipro_get_devices_count(uint8_t version) {
     }
   }
   libusb_free_device_list(devs, 1);
-  libusb_exit(NULL);
+  libusb_exit(context);
   return devices;
 }
 
@@ -122,10 +171,10 @@ static void payload_transfer_cb(struct libusb_transfer *transfer) {
   }
 }
 
-static int msg_transfer(void *handle, uint8_t *buffer, size_t size,
+static int msg_transfer(usb_device_t *device, uint8_t *buffer, size_t size,
                         uint8_t direction, uint8_t endpoint,
                         int *bytes_transferred, uint32_t timeout) {
-  int ret = libusb_bulk_transfer(handle, (endpoint | direction), buffer, size,
+  int ret = libusb_bulk_transfer(device->handle, (endpoint | direction), buffer, size,
                                  bytes_transferred, timeout);
 
   if (ret != LIBUSB_SUCCESS)
@@ -133,7 +182,7 @@ static int msg_transfer(void *handle, uint8_t *buffer, size_t size,
   return ret;
 }
 
-static int payload_transfer(void *handle, uint8_t direction,
+static int payload_transfer(usb_device_t *device, uint8_t direction,
                             uint8_t *ep2_buffer, size_t ep2_length,
                             uint8_t *ep3_buffer, size_t ep3_length) {
   struct libusb_transfer *ep2_urb;
@@ -149,10 +198,10 @@ static int payload_transfer(void *handle, uint8_t direction,
     return EXIT_FAILURE;
   }
 
-  libusb_fill_bulk_transfer(ep2_urb, handle, (0x02 | direction), ep2_buffer,
+  libusb_fill_bulk_transfer(ep2_urb, device->handle, (0x02 | direction), ep2_buffer,
                             ep2_length, payload_transfer_cb, &ep2_completed,
                             MP_USBTIMEOUT);
-  libusb_fill_bulk_transfer(ep3_urb, handle, (0x03 | direction), ep3_buffer,
+  libusb_fill_bulk_transfer(ep3_urb, device->handle, (0x03 | direction), ep3_buffer,
                             ep3_length, payload_transfer_cb, &ep3_completed,
                             MP_USBTIMEOUT);
 
@@ -170,7 +219,7 @@ static int payload_transfer(void *handle, uint8_t direction,
   }
 
   while (!ep2_completed) {
-    ret = libusb_handle_events_completed(NULL, &ep2_completed);
+    ret = libusb_handle_events_completed(device->context, &ep2_completed);
     if (ret < 0) {
       if (ret == LIBUSB_ERROR_INTERRUPTED) continue;
       libusb_cancel_transfer(ep2_urb);
@@ -179,7 +228,7 @@ static int payload_transfer(void *handle, uint8_t direction,
     }
   }
   while (!ep3_completed) {
-    ret = libusb_handle_events_completed(NULL, &ep3_completed);
+    ret = libusb_handle_events_completed(device->context, &ep3_completed);
     if (ret < 0) {
       if (ret == LIBUSB_ERROR_INTERRUPTED) continue;
       libusb_cancel_transfer(ep2_urb);
@@ -45,7 +45,7 @@
   }
 
 // Internaly used functions prototypes
-static int search_devices(uint8_t, char **);
+static int search_devices(uint8_t, int, char **);
 static int usb_write(void *, uint8_t *, size_t, uint8_t);
 static int usb_read(void *, uint8_t *, size_t, uint8_t);
 static int payload_transfer(void *, uint8_t, uint8_t *, size_t, uint8_t *,
@@ -55,11 +55,12 @@ static int payload_transfer(void *, uint8_t, uint8_t *, size_t, uint8_t *,
 typedef struct usb_handle {
   HANDLE DeviceHandle;
   WINUSB_INTERFACE_HANDLE InterfaceHandle;
+  char *DevicePath;
 } usb_handle_t;
 
 // Open usb device
-void *usb_open(uint8_t verbose) {
-  char *device_path;
+void *usb_open(int index, uint8_t verbose) {
+  char *device_path = NULL;
 
   // Alocate memory for the usb handle structure
   usb_handle_t *handle = malloc(sizeof(usb_handle_t));
@@ -73,32 +74,34 @@ void *usb_open(uint8_t verbose) {
   handle->InterfaceHandle = NULL;
 
   // First search for TL866A/CS
-  int count = search_devices(MP_TL866A, &device_path);
-  if (count) {
+  int count = search_devices(MP_TL866A, index, &device_path);
+  if (index < count) {
     handle->DeviceHandle = CreateFileA(
         device_path, GENERIC_READ | GENERIC_WRITE,
         FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
-    free(device_path);
     if (handle->DeviceHandle == INVALID_HANDLE_VALUE) {
       if(verbose)
     	  fprintf(stderr, "No programmer found.\n");
+      free(device_path);
       free(handle);
       return NULL;
     }
+    handle->DevicePath = device_path;
     return handle;
   }
 
   // Then search for TL866II+
-  count = search_devices(MP_TL866IIPLUS, &device_path);
-  if (count) {
+  index -= count;
+  count = search_devices(MP_TL866IIPLUS, index, &device_path);
+  if (index < count) {
     handle->DeviceHandle =
         CreateFileA(device_path, GENERIC_READ | GENERIC_WRITE,
                     FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
                     FILE_FLAG_OVERLAPPED, NULL);
-    free(device_path);
     if (handle->DeviceHandle == INVALID_HANDLE_VALUE) {
       if(verbose)
     	  fprintf(stderr, "No programmer found.\n");
+      free(device_path);
       free(handle);
       return NULL;
     }
@@ -111,28 +114,36 @@ void *usb_open(uint8_t verbose) {
                            &value);
       WinUsb_SetPipePolicy(handle->InterfaceHandle, 0x83, AUTO_FLUSH, 1,
                            &value);
+      handle->DevicePath = device_path;
       return handle;
     }
+    CloseHandle(handle->DeviceHandle);
   }
 
   if(verbose)
 	  fprintf(stderr, "No programmer found.\n");
+  free(device_path);
   free(handle);
   return NULL;
 }
 
+void usb_location(void *handle, char *location, size_t size) {
+  snprintf(location, size, "%s", ((usb_handle_t *)handle)->DevicePath);
+}
+
 // Close usb device
 int usb_close(void *handle) {
   if (((usb_handle_t *)handle)->InterfaceHandle)
     WinUsb_Free(((usb_handle_t *)handle)->InterfaceHandle);
   CloseHandle(((usb_handle_t *)handle)->DeviceHandle);
+  free(((usb_handle_t *)handle)->DevicePath);
   free(handle);
   return EXIT_SUCCESS;
 }
 
 // Get no. of devices connected
 int minipro_get_devices_count(uint8_t version) {
-  return search_devices(version, NULL);
+  return search_devices(version, 0, NULL);
 }
 
 // synchronously message send
@@ -340,10 +351,10 @@ static int usb_read(void *handle, uint8_t *buffer, size_t size,
 
 /* This function will scan for connected devices.
  *  If the device_path is not null then this function will
- *  return here the path of the first device found.
+ *  return here the path of the index-th device found.
  *  Don't forget to call free(device_path) to free the allocated memory.
  */
-static int search_devices(uint8_t version, char **device_path) {
+static int search_devices(uint8_t version, int index, char **device_path) {
   uint32_t idx = 0;
   uint32_t devices = 0;
 
@@ -382,7 +393,7 @@ static int search_devices(uint8_t version, char **device_path) {
       if (SetupDiGetDeviceInterfaceDetail(handle, &deviceinterfacedata,
                                           deviceinterfacedetaildata, datasize,
                                           &size, NULL)) {
-        if (!devices && device_path) {
+        if (devices == (uint32_t)index && device_path) {
           *device_path = strdup(deviceinterfacedetaildata->DevicePath);
         }
         devices++;